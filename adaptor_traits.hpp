@@ -0,0 +1,131 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ADAPTOR_TRAITS_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ADAPTOR_TRAITS_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// What node_kind gives, for adaptors that define it
+enum class node_kind_type {
+    element,
+    text,
+    other
+};
+
+namespace adaptor_detail {
+    template <typename...>
+    struct always_void {
+        typedef void type;
+    };
+
+    template <typename Adaptor>
+    typename Adaptor::node_type const& node();
+}
+
+// Detects the optional functions of an adaptor at compile time. The
+// context uses them when they are there, and falls back to the
+// functions every adaptor has otherwise:
+//   name_cstr(node)                     the qualified name, not copied,
+//                                       instead of name
+//   name_equals(node, local, size)      if the local part of the name
+//                                       is the given characters, instead
+//                                       of comparing the name
+//   node_kind(node)                     a node_kind_type, used to skip
+//                                       the nodes that are not elements
+//                                       when there is no
+//                                       first_element_child
+//   attribute_cstr(node, name)          the value of the attribute, not
+//                                       copied, or null if the node does
+//                                       not have it, instead of attribute
+//   child_count(node)                   the number of children, instead
+//                                       of has_children
+//   first_element_child(node)           and next_element_sibling, see
+//                                       axis_step.hpp
+// Each has_... trait derives from std::true_type when the adaptor
+// defines the function.
+template <typename Adaptor, typename = void>
+struct has_name_cstr: std::false_type {
+};
+
+template <typename Adaptor>
+struct has_name_cstr<Adaptor, typename adaptor_detail::always_void<
+        decltype(Adaptor::name_cstr(adaptor_detail::node<Adaptor>()))>::type>
+    : std::true_type {
+};
+
+template <typename Adaptor, typename = void>
+struct has_name_equals: std::false_type {
+};
+
+template <typename Adaptor>
+struct has_name_equals<Adaptor, typename adaptor_detail::always_void<
+        decltype(Adaptor::name_equals(adaptor_detail::node<Adaptor>(),
+                                      std::declval<const char*>(), std::size_t()))>::type>
+    : std::true_type {
+};
+
+template <typename Adaptor, typename = void>
+struct has_node_kind: std::false_type {
+};
+
+template <typename Adaptor>
+struct has_node_kind<Adaptor, typename adaptor_detail::always_void<
+        decltype(Adaptor::node_kind(adaptor_detail::node<Adaptor>()))>::type>
+    : std::true_type {
+};
+
+template <typename Adaptor, typename = void>
+struct has_attribute_cstr: std::false_type {
+};
+
+template <typename Adaptor>
+struct has_attribute_cstr<Adaptor, typename adaptor_detail::always_void<
+        decltype(Adaptor::attribute_cstr(adaptor_detail::node<Adaptor>(),
+                                         std::declval<const char*>()))>::type>
+    : std::true_type {
+};
+
+template <typename Adaptor, typename = void>
+struct has_child_count: std::false_type {
+};
+
+template <typename Adaptor>
+struct has_child_count<Adaptor, typename adaptor_detail::always_void<
+        decltype(Adaptor::child_count(adaptor_detail::node<Adaptor>()))>::type>
+    : std::true_type {
+};
+
+template <typename Adaptor, typename = void>
+struct has_element_siblings: std::false_type {
+};
+
+template <typename Adaptor>
+struct has_element_siblings<Adaptor, typename adaptor_detail::always_void<
+        decltype(Adaptor::first_element_child(adaptor_detail::node<Adaptor>())),
+        decltype(Adaptor::next_element_sibling(adaptor_detail::node<Adaptor>()))>::type>
+    : std::true_type {
+};
+
+// All the capabilities of an adaptor, e.g.
+// 'adaptor_traits<PugiXmlAdaptor>::attribute_cstr'
+template <typename Adaptor>
+struct adaptor_traits {
+    static constexpr bool name_cstr = has_name_cstr<Adaptor>::value;
+    static constexpr bool name_equals = has_name_equals<Adaptor>::value;
+    static constexpr bool node_kind = has_node_kind<Adaptor>::value;
+    static constexpr bool attribute_cstr = has_attribute_cstr<Adaptor>::value;
+    static constexpr bool child_count = has_child_count<Adaptor>::value;
+    static constexpr bool element_siblings = has_element_siblings<Adaptor>::value;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ADAPTOR_TRAITS_HPP
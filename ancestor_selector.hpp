@@ -9,12 +9,13 @@
 
 #include "selector_common.hpp"
 #include "ancestor_iterator.hpp"
+#include "distinct_ancestor_iterator.hpp"
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 
 struct filtered_ancestor {
-    explicit filtered_ancestor(std::string s): name(std::move(s)) {
+    explicit filtered_ancestor(std::string const& s): name(s) {
     }
 
     filtered_ancestor(filtered_ancestor&& other)
@@ -25,7 +26,7 @@ struct filtered_ancestor {
         : name(other.name) {
     }
 
-    std::string name;
+    selector_name name;
 };
 
 // the type for the ancestor selector
@@ -38,11 +39,35 @@ public:
     }
 };
 
+// the name given to the distinct_ancestor selector
+struct filtered_distinct_ancestor {
+    explicit filtered_distinct_ancestor(std::string const& s): name(s) {
+    }
+
+    selector_name name;
+};
+
+// the type for the distinct_ancestor selector
+class _distinct_ancestor {
+public:
+    filtered_distinct_ancestor operator()(std::string name) const {
+        return filtered_distinct_ancestor(name);
+    }
+};
+
 namespace {
     /// The ancestor selector object. Can be used as a function
     /// taking a name of the target ancestor. I.e. 'range | ancestor'
     /// or 'range | ancestor("foo")'
     const _ancestor ancestor;
+
+    /// Like ancestor, but gives each ancestor once, e.g.
+    /// 'range | distinct_ancestor' or 'range | distinct_ancestor("foo")'.
+    /// The climb from a node stops at the ancestors of the node before
+    /// it, so siblings cost one step. With the input in document order
+    /// the ancestors come in document order, top down, where ancestor
+    /// gives them bottom up for each node.
+    const _distinct_ancestor distinct_ancestor;
 }
 
 // the implementation of the pipe operator that takes
@@ -68,6 +93,29 @@ operator|(Range const& range,
             | boost::adaptors::filtered(name_predicate<typename Range::iterator::reference>(f.name));
 }
 
+// the implementation of the pipe operator that takes a range
+// and a distinct_ancestor. E.g. 'range | distinct_ancestor'
+template <typename Range>
+boost::iterator_range<distinct_ancestor_iterator<typename Range::iterator> >
+operator|(Range const& range,
+          _distinct_ancestor const&)
+{
+    return make_distinct_ancestor(range);
+}
+
+// the implementation of the pipe operator that takes a range and a
+// filtered_distinct_ancestor. E.g. 'range | distinct_ancestor("foo")'
+template <typename Range>
+boost::range_detail::filtered_range
+<name_predicate<typename Range::iterator::reference>,
+ const boost::iterator_range<distinct_ancestor_iterator<typename Range::iterator> > >
+operator|(Range const& range,
+          filtered_distinct_ancestor f)
+{
+    return make_distinct_ancestor(range)
+            | boost::adaptors::filtered(name_predicate<typename Range::iterator::reference>(f.name));
+}
+
 // enables _ancestor type as a sub-expression
 template <>
 struct is_expr<_ancestor>: std::true_type {
@@ -78,6 +126,25 @@ template <>
 struct is_expr<filtered_ancestor>: std::true_type {
 };
 
+// enables the distinct_ancestor selectors as sub-expressions
+template <>
+struct is_expr<_distinct_ancestor>: std::true_type {
+};
+
+template <>
+struct is_expr<filtered_distinct_ancestor>: std::true_type {
+};
+
+// the distinct_ancestor selectors remember the ancestors of the whole
+// range
+template <>
+struct is_range_selector<_distinct_ancestor>: std::true_type {
+};
+
+template <>
+struct is_range_selector<filtered_distinct_ancestor>: std::true_type {
+};
+
 
 }}}}
 
@@ -0,0 +1,157 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ATTRIBUTE_INDEX_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ATTRIBUTE_INDEX_HPP
+
+#include "indexed_document.hpp"
+#include "name_index.hpp"
+#include "selector_common.hpp"
+
+#include <boost/range/adaptor/filtered.hpp>
+
+#include <algorithm>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// A hash index over the values of chosen attributes, e.g. "id" and
+// "ref". Maps each value of an indexed attribute to the ids of the
+// nodes that have the attribute set to that value, in document order.
+// Only the chosen attributes are indexed. Asking for another attribute
+// throws std::invalid_argument rather than giving an empty answer. So
+// does asking for the empty value: attribute("id", "") also matches
+// the nodes without the attribute, which are not indexed.
+class attribute_index {
+public:
+    typedef indexed_document::id_type id_type;
+    typedef name_index::id_list id_list;
+
+    attribute_index(indexed_document const& document, std::initializer_list<std::string> names)
+        : doc(&document) {
+        build(names.begin(), names.end());
+    }
+
+    attribute_index(indexed_document const& document, std::vector<std::string> const& names)
+        : doc(&document) {
+        build(names.begin(), names.end());
+    }
+
+    indexed_document const& document() const {
+        return *doc;
+    }
+
+    bool is_indexed(std::string const& name) const {
+        return attributes.find(name) != attributes.end();
+    }
+
+    // the ids of the nodes with the attribute set to the value, in
+    // document order. The value must not be empty, see above
+    id_list const& nodes(std::string const& name, std::string const& value) const {
+        static const id_list none;
+        auto a = attributes.find(name);
+        if (a == attributes.end()) {
+            throw std::invalid_argument("attribute '" + name + "' is not indexed");
+        }
+        if (value.empty()) {
+            throw std::invalid_argument("the empty value of attribute '" + name + "' is not indexed");
+        }
+        auto v = a->second.find(value);
+        return v == a->second.end() ? none : v->second;
+    }
+
+private:
+    template <typename Iterator>
+    void build(Iterator begin, Iterator end) {
+        for (; begin != end; ++begin) {
+            attributes[*begin];
+        }
+        for (id_type id = 0; id < doc->size(); ++id) {
+            for (pugi::xml_attribute a = doc->node(id).first_attribute(); a; a = a.next_attribute()) {
+                auto i = attributes.find(a.name());
+                if (i != attributes.end()) {
+                    i->second[a.value()].push_back(id);
+                }
+            }
+        }
+    }
+
+    indexed_document const* doc;
+    // name -> value -> ids
+    std::unordered_map<std::string, std::unordered_map<std::string, id_list> > attributes;
+};
+
+// Predicate for the nodes which are in a list of ids
+template <typename Context>
+struct id_in_list {
+    typedef bool result_type;
+
+    bool operator()(Context const& c) const {
+        indexed_document::id_type id = document->id_of(c);
+        return std::binary_search(list->begin(), list->end(), id);
+    }
+
+    attribute_index::id_list const* list;
+    indexed_document const* document;
+};
+
+// the attribute selector filtered on name and value, using an index
+struct indexed_attribute_filter {
+    indexed_attribute_filter(attribute_index::id_list const& list, indexed_document const& document)
+        : list(&list), document(&document) {
+    }
+
+    attribute_index::id_list const* list;
+    indexed_document const* document;
+};
+
+/// Selects the descendants which have the attribute set to the value,
+/// like 'descendant | attribute("id", v)', with a hash probe instead of
+/// visiting the descendants, e.g.
+/// 'range | indexed_descendant(attributes, "id", v)'.
+/// The index must outlive the results. Throws std::invalid_argument
+/// for an empty value, which attribute("id", "") would also match on
+/// the nodes without the attribute.
+inline indexed_descendant_filter indexed_descendant(attribute_index const& index,
+                                                    std::string const& name,
+                                                    std::string const& value) {
+    return indexed_descendant_filter(index.nodes(name, value), index.document());
+}
+
+/// Selects the nodes of the range which have the attribute set to the
+/// value, like 'attribute("id", v)', e.g.
+/// 'range | indexed_attribute(attributes, "id", v)'. Throws
+/// std::invalid_argument for an empty value, as indexed_descendant
+inline indexed_attribute_filter indexed_attribute(attribute_index const& index,
+                                                  std::string const& name,
+                                                  std::string const& value) {
+    return indexed_attribute_filter(index.nodes(name, value), index.document());
+}
+
+// Implements the pipe operator for the indexed_attribute selector
+template <typename Range>
+boost::range_detail::filtered_range
+<id_in_list<typename Range::iterator::value_type>, const Range>
+operator|(Range const& range, indexed_attribute_filter f)
+{
+    id_in_list<typename Range::iterator::value_type> p;
+    p.list = f.list;
+    p.document = f.document;
+    return range | boost::adaptors::filtered(p);
+}
+
+// enables the indexed_attribute selector in sub-expressions
+template <>
+struct is_expr<indexed_attribute_filter>: std::true_type {
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ATTRIBUTE_INDEX_HPP
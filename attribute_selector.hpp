@@ -69,7 +69,7 @@ struct filtered_attribute_name_and_value {
 
     template <typename C>
     bool operator()(C const& s) const {
-        return s.attribute(name) == value;
+        return s.attribute_equals(name, value);
     }
 
     std::string name;
@@ -0,0 +1,56 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_AXIS_STEP_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_AXIS_STEP_HPP
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// How the child and descendant iterators move between the nodes of
+// the tree. Each function moves the context and returns true, or
+// returns false and leaves the context as it is if there is no such
+// node.
+
+// Every node the adaptor gives, including text, comments and
+// processing instructions
+struct all_nodes {
+    template <typename Context>
+    static bool first_child(Context& c) {
+        if (!c.has_children()) {
+            return false;
+        }
+        c.first_child();
+        return true;
+    }
+
+    template <typename Context>
+    static bool next_sibling(Context& c) {
+        if (!c.has_next_sibling()) {
+            return false;
+        }
+        c.next_sibling();
+        return true;
+    }
+};
+
+// Only the elements. The other nodes are skipped by the adaptor, with
+// first_element_child and next_element_sibling, so the context never
+// visits them
+struct element_nodes {
+    template <typename Context>
+    static bool first_child(Context& c) {
+        return c.first_element_child();
+    }
+
+    template <typename Context>
+    static bool next_sibling(Context& c) {
+        return c.next_element_sibling();
+    }
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_AXIS_STEP_HPP
@@ -0,0 +1,124 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_BATCH_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_BATCH_HPP
+
+#include "erased_range.hpp"
+
+#include <boost/range/begin.hpp>
+#include <boost/range/end.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/range/value_type.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+/// Copies up to n entries from it into out and moves it past them.
+/// Returns the number of entries, fewer than n only when it reaches
+/// end.
+template <typename Iterator, typename T>
+std::size_t next_batch(Iterator& it, Iterator const& end, T* out, std::size_t n) {
+    std::size_t copied = 0;
+    for (; copied < n && it != end; ++it) {
+        out[copied++] = *it;
+    }
+    return copied;
+}
+
+/// As above, for the iterators of range<T>, which copy the entries
+/// with one virtual call instead of one per entry.
+template <typename T>
+std::size_t next_batch(erased_iterator<T>& it, erased_iterator<T> const&, T* out, std::size_t n) {
+    return it.next_batch(out, n);
+}
+
+// The argument for_each_batch gives to its function
+template <typename T>
+using batch_range = boost::iterator_range<T const*>;
+
+/// Calls f with the entries of the range in batches of up to
+/// batch_size, as a boost::iterator_range over a contiguous array,
+/// e.g.
+///   for_each_batch(c | descendant("item"), [](batch_range<C> items) {
+///       for (C const& item: items) ...
+///   });
+/// so the loop over each batch is free of the iterators of the range.
+/// The array is reused, so the entries must be copied to keep them
+/// after f returns. Its entries are copied from the range when they are
+/// first filled, and assigned in later batches, so a context array
+/// mostly reuses the memory of the contexts it held before. See
+/// for_each_node_batch to not copy the contexts at all. Returns the
+/// number of entries. Throws std::invalid_argument if batch_size is 0.
+template <typename Range, typename Function>
+std::size_t for_each_batch(Range const& range, Function f, std::size_t batch_size = 64) {
+    typedef typename boost::range_value<Range>::type value_type;
+    if (batch_size == 0) {
+        throw std::invalid_argument("for_each_batch needs a batch size above 0");
+    }
+    std::vector<value_type> buffer;
+    buffer.reserve(batch_size);
+    auto it = boost::begin(range);
+    auto end = boost::end(range);
+    std::size_t total = 0;
+    for (;;) {
+        std::size_t n = buffer.empty() ? 0 : next_batch(it, end, buffer.data(), buffer.size());
+        if (n == buffer.size()) {
+            for (; buffer.size() < batch_size && it != end; ++it) {
+                buffer.push_back(*it);
+                ++n;
+            }
+        }
+        if (n > 0) {
+            value_type const* first = buffer.data();
+            f(batch_range<value_type>(first, first + n));
+            total += n;
+        }
+        if (n < batch_size) {
+            return total;
+        }
+    }
+}
+
+/// As for_each_batch, for a range of contexts, but calls f with the
+/// nodes of the contexts, e.g.
+///   for_each_node_batch(c | descendant("item"), [](batch_range<pugi::xml_node> items) {
+///       ...
+///   });
+/// The contexts are not copied, so this is the cheaper one when the
+/// namespaces in scope are not needed.
+template <typename Range, typename Function>
+std::size_t for_each_node_batch(Range const& range, Function f, std::size_t batch_size = 64) {
+    typedef typename boost::range_value<Range>::type::node_type node_type;
+    if (batch_size == 0) {
+        throw std::invalid_argument("for_each_node_batch needs a batch size above 0");
+    }
+    std::vector<node_type> buffer(batch_size);
+    auto it = boost::begin(range);
+    auto end = boost::end(range);
+    std::size_t total = 0;
+    for (;;) {
+        std::size_t n = 0;
+        for (; n < batch_size && it != end; ++it) {
+            buffer[n++] = (*it).get_node();
+        }
+        if (n > 0) {
+            node_type const* first = buffer.data();
+            f(batch_range<node_type>(first, first + n));
+            total += n;
+        }
+        if (n < batch_size) {
+            return total;
+        }
+    }
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_BATCH_HPP
@@ -0,0 +1,444 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+// Benchmark for the selectors in xpath.hpp. Generates synthetic documents
+// of different shapes and sizes, runs one query per selector over each of
+// them and reports nodes/sec, ns/result and heap allocations per query.
+//
+// Usage: xtpath_bench [size...] [--shape wide|deep|ns|attr] [--min-time seconds]
+//                     [--namespaces scoped|linked|lazy|flat]
+// Sizes are given in bytes with an optional K, M or G suffix, e.g. 64K 16M.
+
+#include "../pugi_adaptor.hpp"
+#include "../batch.hpp"
+#include "../name_index.hpp"
+#include "../parallel.hpp"
+#include "../query_set.hpp"
+
+#include <pugixml.hpp>
+
+#include <boost/range/any_range.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace mediasequencer::plugin::util::xpath;
+
+namespace {
+    std::atomic<std::size_t> allocation_count(0);
+}
+
+// counts every heap allocation made while the benchmark runs, so that
+// the allocations per query can be reported
+void* operator new(std::size_t size) {
+    ++allocation_count;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// Appends elements to an xml string until it reaches the wanted size.
+// Every shape uses the element names "item" and "leaf", so the same
+// queries can be run against all of them.
+class document_generator {
+public:
+    explicit document_generator(std::size_t target_size)
+        : target_size(target_size) {
+        xml.reserve(target_size + 4096);
+    }
+
+    std::string wide() {
+        begin_root("");
+        while (xml.size() < target_size) {
+            xml += "<item id=\"" + next_id() + "\" kind=\"" + kind() + "\">";
+            leaf();
+            leaf();
+            xml += "</item>";
+        }
+        return end_root();
+    }
+
+    std::string deep() {
+        const int depth = 32;
+        begin_root("");
+        while (xml.size() < target_size) {
+            for (int i = 0; i < depth; ++i) {
+                xml += "<item id=\"" + next_id() + "\" kind=\"" + kind() + "\">";
+                leaf();
+            }
+            for (int i = 0; i < depth; ++i) {
+                xml += "</item>";
+            }
+        }
+        return end_root();
+    }
+
+    std::string namespaced() {
+        begin_root(" xmlns=\"urn:default\" xmlns:a=\"urn:a\" xmlns:b=\"urn:b\"");
+        while (xml.size() < target_size) {
+            std::string prefix = "p" + std::to_string(counter % 8);
+            xml += "<" + prefix + ":item xmlns:" + prefix + "=\"urn:" + prefix +
+                    "\" id=\"" + next_id() + "\" kind=\"" + kind() + "\">";
+            xml += "<a:leaf>" + next_id() + "</a:leaf>";
+            xml += "<" + prefix + ":leaf xmlns=\"urn:inner\">" + next_id() + "</" + prefix + ":leaf>";
+            xml += "</" + prefix + ":item>";
+        }
+        return end_root();
+    }
+
+    std::string attribute_heavy() {
+        begin_root("");
+        while (xml.size() < target_size) {
+            xml += "<item id=\"" + next_id() + "\" kind=\"" + kind() + "\"";
+            for (int i = 0; i < 14; ++i) {
+                xml += " a" + std::to_string(i) + "=\"v" + std::to_string(i) + "\"";
+            }
+            xml += ">";
+            xml += "<leaf id=\"" + next_id() + "\"";
+            for (int i = 0; i < 7; ++i) {
+                xml += " b" + std::to_string(i) + "=\"w" + std::to_string(i) + "\"";
+            }
+            xml += ">" + next_id() + "</leaf>";
+            xml += "</item>";
+        }
+        return end_root();
+    }
+
+private:
+    void begin_root(std::string const& attributes) {
+        xml = "<root" + attributes + ">";
+    }
+
+    std::string end_root() {
+        xml += "</root>";
+        return std::move(xml);
+    }
+
+    void leaf() {
+        xml += "<leaf>" + next_id() + "</leaf>";
+    }
+
+    std::string next_id() {
+        return std::to_string(counter++);
+    }
+
+    const char* kind() const {
+        return counter % 3 == 0 ? "b" : "a";
+    }
+
+    std::size_t target_size;
+    std::size_t counter = 0;
+    std::string xml;
+};
+
+// counts all nodes in the document, used to report nodes/sec
+std::size_t count_nodes(pugi::xml_node const& node) {
+    std::size_t n = 1;
+    for (pugi::xml_node c = node.first_child(); c; c = c.next_sibling()) {
+        n += count_nodes(c);
+    }
+    return n;
+}
+
+// The indexes of the document being measured, built once per document
+// outside the measurements
+struct document_indexes {
+    std::unique_ptr<indexed_document> document;
+    std::unique_ptr<name_index> names;
+};
+
+document_indexes indexes;
+
+// A named query. Returns the number of results it produced
+template <typename Context>
+struct query {
+    const char* selector;
+    std::function<std::size_t(Context const&)> run;
+};
+
+// dereferences every result, so that transformations like ns and
+// attribute are actually evaluated
+template <typename Range>
+std::size_t count_results(Range const& r) {
+    std::size_t n = 0;
+    for (auto i = r.begin(); i != r.end(); ++i) {
+        auto&& result = *i;
+        static_cast<void>(result);
+        ++n;
+    }
+    return n;
+}
+
+template <typename Context>
+std::vector<query<Context> > make_queries() {
+    typedef Context const& C;
+    return {
+        {"child", [](C c) { return count_results(c | child | child("leaf")); }},
+        {"descendant", [](C c) { return count_results(c | descendant("leaf")); }},
+        {"element_descendant", [](C c) { return count_results(c | element_descendant("leaf")); }},
+        {"nested", [](C c) { return count_results(c | descendant("item") | descendant("leaf")); }},
+        {"nested_distinct", [](C c) {
+            return count_results(c | descendant("item") | distinct_descendant("leaf"));
+        }},
+        {"range", [](C c) { return count_results(range<Context>(c | descendant("leaf"))); }},
+        {"any_range", [](C c) {
+            // what range<T> was before, for comparison
+            typedef boost::any_range<Context, boost::forward_traversal_tag, Context&, std::ptrdiff_t> any;
+            return count_results(any(c | descendant("leaf")));
+        }},
+        {"range_text", [](C c) { return count_results(range<std::string>(c | descendant("leaf") | text)); }},
+        {"descendant_batch", [](C c) {
+            std::size_t n = 0;
+            for_each_batch(c | descendant("leaf"), [&n](batch_range<Context> leaves) {
+                n += leaves.size();
+            });
+            return n;
+        }},
+        {"descendant_node_batch", [](C c) {
+            std::size_t n = 0;
+            for_each_node_batch(c | descendant("leaf"), [&n](batch_range<pugi::xml_node> leaves) {
+                n += leaves.size();
+            });
+            return n;
+        }},
+        {"indexed_descendant", [](C c) {
+            return count_results(c | indexed_descendant(*indexes.names, "leaf"));
+        }},
+        {"indexed_nested", [](C c) {
+            return count_results(c | descendant("item") | indexed_descendant(*indexes.names, "leaf"));
+        }},
+        {"descendant_vector", [](C c) {
+            auto r = c | descendant("leaf");
+            return std::vector<Context>(r.begin(), r.end()).size();
+        }},
+        {"descendant_par", [](C c) { return evaluate(par, c, descendant("leaf")).size(); }},
+        {"ancestor", [](C c) { return count_results(c | child | child("leaf") | ancestor); }},
+        {"parent", [](C c) { return count_results(c | descendant("leaf") | parent); }},
+        {"distinct_parent", [](C c) { return count_results(c | descendant("leaf") | distinct_parent); }},
+        {"distinct_ancestor", [](C c) {
+            return count_results(c | child | child("leaf") | distinct_ancestor);
+        }},
+        {"where", [](C c) {
+            return count_results(c | descendant("item") | where(attribute("kind", "b")));
+        }},
+        {"where_par", [](C c) {
+            return evaluate(par, c, descendant("item") | where(attribute("kind", "b"))).size();
+        }},
+        {"attribute", [](C c) { return count_results(c | descendant | attribute("id")); }},
+        {"attribute_view", [](C c) { return count_results(c | descendant | attribute_view("id")); }},
+        {"ns", [](C c) { return count_results(c | descendant | ns); }},
+        {"text", [](C c) {
+            std::size_t n = 0;
+            for (std::string const& s: c | descendant("leaf") | text) {
+                n += !s.empty();
+            }
+            return n;
+        }},
+        {"text_view", [](C c) {
+            std::size_t n = 0;
+            for (string_view s: c | descendant("leaf") | text_view) {
+                n += !s.empty();
+            }
+            return n;
+        }},
+        {"query_set", [](C c) {
+            // the same four queries as separate walks and as one set
+            static query_set<Context> set = [] {
+                query_set<Context> s;
+                for (const char* q: {"//leaf", "//item/@id", "//item[@kind='b']", "item/leaf/text()"}) {
+                    s.add(q);
+                }
+                return s;
+            }();
+            std::size_t n = 0;
+            for (auto const& results: set.strings(c)) {
+                n += results.size();
+            }
+            return n;
+        }},
+        {"concatenate", [](C c) {
+            std::string s = c | descendant("leaf") | text | concatenate(",");
+            return static_cast<std::size_t>(!s.empty());
+        }}
+    };
+}
+
+struct measurement {
+    std::size_t runs;
+    std::size_t results;
+    double seconds;
+    std::size_t allocations;
+};
+
+// a new context is built for every run, so no state is carried
+// over from one run to the next
+template <typename Context>
+measurement measure(query<Context> const& q, pugi::xml_node const& root, double min_time) {
+    typedef std::chrono::steady_clock clock;
+    measurement m = {0, 0, 0.0, 0};
+    std::size_t allocations_before = allocation_count;
+    auto start = clock::now();
+    do {
+        m.results = q.run(Context(root));
+        ++m.runs;
+        m.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while (m.seconds < min_time);
+    m.allocations = allocation_count - allocations_before;
+    return m;
+}
+
+// returns 0 if the string is not a size, e.g. "--help" or "12X"
+std::size_t parse_size(std::string const& s) {
+    char* end = nullptr;
+    double value = std::strtod(s.c_str(), &end);
+    if (end == s.c_str() || value <= 0) {
+        return 0;
+    }
+    switch (*end) {
+    case 'k': case 'K': value *= 1024; ++end; break;
+    case 'm': case 'M': value *= 1024 * 1024; ++end; break;
+    case 'g': case 'G': value *= 1024 * 1024 * 1024; ++end; break;
+    default: break;
+    }
+    if (*end != '\0') {
+        return 0;
+    }
+    return static_cast<std::size_t>(value);
+}
+
+int usage(const char* program) {
+    std::fprintf(stderr,
+                 "usage: %s [size...] [--shape wide|deep|ns|attr] [--min-time seconds]\n"
+                 "       [--namespaces scoped|linked|lazy|flat]\n"
+                 "sizes are in bytes with an optional K, M or G suffix, e.g. 64K 16M\n",
+                 program);
+    return 1;
+}
+
+std::string generate(std::string const& shape, std::size_t size) {
+    document_generator generator(size);
+    if (shape == "wide") return generator.wide();
+    if (shape == "deep") return generator.deep();
+    if (shape == "ns") return generator.namespaced();
+    return generator.attribute_heavy();
+}
+
+template <typename Context>
+void run_queries(std::string const& shape, std::size_t bytes,
+                 pugi::xml_node const& root, double min_time) {
+    std::size_t nodes = count_nodes(root);
+
+    for (query<Context> const& q: make_queries<Context>()) {
+        measurement m = measure(q, root, min_time);
+        double per_query = m.seconds / m.runs;
+        std::printf("%-6s %10zu %10zu  %-14s %10zu %6zu %12.3f %14.0f %12.1f %14.1f\n",
+                    shape.c_str(), bytes, nodes, q.selector, m.results, m.runs,
+                    per_query * 1e3,
+                    nodes / per_query,
+                    m.results ? per_query * 1e9 / m.results : 0.0,
+                    static_cast<double>(m.allocations) / m.runs);
+    }
+}
+
+void run_shape(std::string const& shape, std::size_t size,
+               std::string const& namespaces, double min_time) {
+    std::string xml = generate(shape, size);
+    pugi::xml_document document;
+    auto status = document.load_buffer(xml.data(), xml.size());
+    if (!status) {
+        std::fprintf(stderr, "parsing error: %s\n", status.description());
+        std::exit(1);
+    }
+    pugi::xml_node root = document.first_child();
+    indexes.document.reset(new indexed_document(root));
+    indexes.names.reset(new name_index(*indexes.document));
+
+    if (namespaces == "flat") {
+        run_queries<_context<PugiXmlAdaptor, pugi::xml_node, flat_namespaces<PugiXmlAdaptor> > >(
+                    shape, xml.size(), root, min_time);
+    } else if (namespaces == "lazy") {
+        run_queries<_context<PugiXmlAdaptor, pugi::xml_node, lazy_namespaces<PugiXmlAdaptor> > >(
+                    shape, xml.size(), root, min_time);
+    } else if (namespaces == "linked") {
+        run_queries<_context<PugiXmlAdaptor, pugi::xml_node, linked_namespaces<PugiXmlAdaptor> > >(
+                    shape, xml.size(), root, min_time);
+    } else {
+        run_queries<_context<PugiXmlAdaptor> >(shape, xml.size(), root, min_time);
+    }
+    indexes = document_indexes();
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::size_t> sizes;
+    std::vector<std::string> shapes;
+    std::string namespaces = "scoped";
+    double min_time = 0.5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+        if (arg == "--shape" && has_value) {
+            std::string shape(argv[++i]);
+            if (shape != "wide" && shape != "deep" && shape != "ns" && shape != "attr") {
+                return usage(argv[0]);
+            }
+            shapes.push_back(shape);
+        } else if (arg == "--min-time" && has_value) {
+            char* end = nullptr;
+            min_time = std::strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || min_time < 0) {
+                return usage(argv[0]);
+            }
+        } else if (arg == "--namespaces" && has_value) {
+            namespaces = argv[++i];
+            if (namespaces != "scoped" && namespaces != "linked" &&
+                    namespaces != "lazy" && namespaces != "flat") {
+                return usage(argv[0]);
+            }
+        } else {
+            std::size_t size = parse_size(arg);
+            if (size == 0) {
+                return usage(argv[0]);
+            }
+            sizes.push_back(size);
+        }
+    }
+    if (sizes.empty()) {
+        sizes = {16 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    }
+    if (shapes.empty()) {
+        shapes = {"wide", "deep", "ns", "attr"};
+    }
+
+    std::printf("%-6s %10s %10s  %-14s %10s %6s %12s %14s %12s %14s\n",
+                "shape", "bytes", "nodes", "selector", "results", "runs",
+                "ms/query", "nodes/sec", "ns/result", "allocs/query");
+    for (std::size_t size: sizes) {
+        for (std::string const& shape: shapes) {
+            run_shape(shape, size, namespaces, min_time);
+        }
+    }
+    return 0;
+}
@@ -7,6 +7,8 @@
 #ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_CHILDREN_ITERATOR
 #define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_CHILDREN_ITERATOR
 
+#include "axis_step.hpp"
+
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/range/iterator_range.hpp>
 #include <boost/range/adaptor/filtered.hpp>
@@ -16,15 +18,15 @@ namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 // An iterator over a range of context nodes. It is given another range
 // of nodes and iterates through all children of all nodes in that
-// other range.
-template <typename ParentIterator>
+// other range. Step chooses the children, see axis_step.hpp.
+template <typename ParentIterator, typename Step = all_nodes>
 class child_iterator : public boost::iterator_facade<
-        child_iterator<ParentIterator>,
+        child_iterator<ParentIterator, Step>,
         typename ParentIterator::value_type,
         boost::forward_traversal_tag> {
 private:
     typedef boost::iterator_facade<
-    child_iterator<ParentIterator>,
+    child_iterator<ParentIterator, Step>,
     typename ParentIterator::value_type,
     boost::forward_traversal_tag> super;
 public:
@@ -41,9 +43,7 @@ public:
         assert(d);
         if (d->parent_it != d->parent_end) {
             d->c.reset(new typename super::value_type(*(d->parent_it)));
-            if (!d->c->is_null() && d->c->has_children()) {
-                d->c->first_child();
-            } else {
+            if (d->c->is_null() || !Step::first_child(*(d->c))) {
                 ++(d->parent_it);
                 reset();
             }
@@ -52,18 +52,18 @@ public:
         }
     }
 
-    child_iterator(child_iterator<ParentIterator> const& other) {
+    child_iterator(child_iterator const& other) {
         if (other.d) {
             d.reset(new data(*(other.d)));
         }
     }
 
-    child_iterator(child_iterator<ParentIterator>&& other)
+    child_iterator(child_iterator&& other)
         : d(std::move(other.d)) {
     }
 
-    child_iterator<ParentIterator>&
-    operator=(child_iterator<ParentIterator> const& other) {
+    child_iterator&
+    operator=(child_iterator const& other) {
         if (other.d) {
             d.reset(new data(*(other.d)));
         } else {
@@ -72,16 +72,14 @@ public:
         return *this;
     }
 
-    child_iterator<ParentIterator>&
-    operator=(child_iterator<ParentIterator>&& other) {
+    child_iterator&
+    operator=(child_iterator&& other) {
         d = std::move(other.d);
         return *this;
     }
 
     void increment() {
-        if (d->c && !d->c->is_null() && d->c->has_next_sibling()) {
-            d->c->next_sibling();
-        } else {
+        if (!d->c || d->c->is_null() || !Step::next_sibling(*(d->c))) {
             ++(d->parent_it);
             reset();
         }
@@ -130,6 +128,14 @@ make_children(Range const& r) {
              child_iterator<typename Range::iterator>());
 }
 
+template <typename Range>
+boost::iterator_range<child_iterator<typename Range::iterator, element_nodes> >
+make_element_children(Range const& r) {
+    return boost::make_iterator_range
+            (child_iterator<typename Range::iterator, element_nodes>(r.begin(), r.end()),
+             child_iterator<typename Range::iterator, element_nodes>());
+}
+
 }}}}
 
 #endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_CHILDREN_ITERATOR
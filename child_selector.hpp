@@ -13,10 +13,10 @@
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 struct filtered_children {
-    explicit filtered_children(std::string s): name(s) {
+    explicit filtered_children(std::string const& s): name(s) {
     }
 
-    std::string name;
+    selector_name name;
 };
 
 // Type for the child selector object
@@ -27,6 +27,22 @@ public:
     }
 };
 
+// the name given to the element_child selector
+struct filtered_element_children {
+    explicit filtered_element_children(std::string const& s): name(s) {
+    }
+
+    selector_name name;
+};
+
+// Type for the element_child selector object
+class _element_child {
+public:
+    filtered_element_children operator()(std::string name) const {
+        return filtered_element_children(name);
+    }
+};
+
 namespace {
     /// Selector object for iterating children. Can be used as
     /// is to get all children, i.e. 'range | child'
@@ -34,6 +50,13 @@ namespace {
     /// to get only the children with matching name
     /// i.e 'range | child("foo")'
     const _child child;
+
+    /// Like child, but gives only the children that are elements,
+    /// i.e. 'range | element_child' or 'range | element_child("foo")'.
+    /// Text, comments and processing instructions are skipped by the
+    /// adaptor, with first_element_child and next_element_sibling, so
+    /// the context does no work for them.
+    const _element_child element_child;
 }
 
 // Implements the pipe operator for the child selector. E.g.
@@ -59,6 +82,29 @@ operator|(Range const& range,
             | boost::adaptors::filtered(name_predicate<typename Range::iterator::value_type>(f.name));
 }
 
+// Implements the pipe operator for the element_child selector. E.g.
+// 'range | element_child'
+template <typename Range>
+boost::iterator_range<child_iterator<typename Range::iterator, element_nodes> >
+operator|(Range const& range,
+          _element_child const&)
+{
+    return make_element_children(range);
+}
+
+// Implements the pipe operator for the filtered_element_children type.
+// E.g. 'range | element_child("foo")'
+template <typename Range>
+boost::range_detail::filtered_range
+<name_predicate<typename Range::iterator::value_type>,
+ const boost::iterator_range<child_iterator<typename Range::iterator, element_nodes> > >
+operator|(Range const& range,
+          filtered_element_children f)
+{
+    return make_element_children(range)
+            | boost::adaptors::filtered(name_predicate<typename Range::iterator::value_type>(f.name));
+}
+
 // enables the _child type in sub-expressions
 template <>
 struct is_expr<_child>: std::true_type {
@@ -67,6 +113,13 @@ struct is_expr<_child>: std::true_type {
 template <>
 struct is_expr<filtered_children>: std::true_type {
 };
+// enables the element_child selectors in sub-expressions
+template <>
+struct is_expr<_element_child>: std::true_type {
+};
+template <>
+struct is_expr<filtered_element_children>: std::true_type {
+};
 
 
 }}}}
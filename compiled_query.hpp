@@ -0,0 +1,287 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_COMPILED_QUERY_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_COMPILED_QUERY_HPP
+
+#include "context.hpp"
+#include "child_selector.hpp"
+#include "descendant_selector.hpp"
+#include "parent_selector.hpp"
+#include "ancestor_selector.hpp"
+#include "attribute_selector.hpp"
+#include "name_selector.hpp"
+#include "text_selector.hpp"
+#include "query_parser.hpp"
+
+#include <boost/range/join.hpp>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// A query string compiled once and evaluated against any number of
+// contexts, e.g.
+//   compiled_query<_context<PugiXmlAdaptor> > q("a/b[@c='d']//e/text()");
+//   for (std::string s: q.strings(context(node))) ...
+// The steps are evaluated with the same iterators as the selectors, so
+// 'q.nodes(c)' gives the same nodes as 'c | child("a") | child("b") | ...',
+// and is type erased to range<Context>. A prefixed name in the query
+// matches the nodes in the namespace bound to the prefix in the
+// namespace_bindings, as seen by the namespace policy of the context.
+// The compiled query is immutable and may be shared between threads.
+template <typename Context>
+class compiled_query {
+public:
+    typedef range<Context> node_range;
+    typedef erased_range<std::string> string_range;
+
+    // throws query_syntax_error if the string can not be parsed, and
+    // std::invalid_argument if it uses a prefix that is not bound
+    explicit compiled_query(std::string const& query,
+                            namespace_bindings const& namespaces = namespace_bindings())
+        : p(compile(parse_query(query), namespaces)) {
+    }
+
+    explicit compiled_query(query_path const& path,
+                            namespace_bindings const& namespaces = namespace_bindings())
+        : p(compile(path, namespaces)) {
+    }
+
+    // what the query gives at the end, see query_result
+    query_result result() const {
+        return p->result;
+    }
+
+    // the nodes selected by the steps of the query. For queries ending
+    // in '@name', only the nodes that have the attribute
+    node_range nodes(Context const& c) const {
+        return nodes(singleton(c));
+    }
+
+    template <typename Range>
+    node_range nodes(Range const& r) const {
+        return select(*p, node_range(r));
+    }
+
+    // the strings given by a query ending in 'text()', '@name' or
+    // 'name()'. For other queries, the text of the selected nodes
+    string_range strings(Context const& c) const {
+        return strings(singleton(c));
+    }
+
+    template <typename Range>
+    string_range strings(Range const& r) const {
+        return to_strings(*p, select(*p, node_range(r)));
+    }
+
+private:
+    struct compiled_path;
+
+    struct compiled_predicate {
+        std::shared_ptr<const compiled_path> path;
+        boost::optional<std::string> equals;
+    };
+
+    struct compiled_step {
+        query_axis axis;
+        bool any_name;
+        selector_name name;
+        // the namespace the node must be in, if the step has a prefix
+        std::shared_ptr<const std::string> uri;
+        std::vector<std::shared_ptr<const compiled_predicate> > predicates;
+    };
+
+    struct compiled_path {
+        bool absolute;
+        std::vector<compiled_step> steps;
+        query_result result;
+        std::string attribute;
+    };
+
+    static std::shared_ptr<const compiled_path>
+    compile(query_path const& path, namespace_bindings const& namespaces) {
+        std::shared_ptr<compiled_path> c = std::make_shared<compiled_path>();
+        c->absolute = path.absolute;
+        c->result = path.result;
+        c->attribute = path.attribute;
+        for (query_step const& step: path.steps) {
+            compiled_step s;
+            s.axis = step.axis;
+            s.any_name = step.name.empty();
+            if (!s.any_name) {
+                s.name = selector_name(step.name);
+            }
+            if (!step.prefix.empty()) {
+                auto i = namespaces.find(step.prefix);
+                if (i == namespaces.end()) {
+                    throw std::invalid_argument("unbound namespace prefix '" + step.prefix + "'");
+                }
+                s.uri = std::make_shared<const std::string>(i->second);
+            }
+            for (query_predicate const& predicate: step.predicates) {
+                std::shared_ptr<compiled_predicate> cp = std::make_shared<compiled_predicate>();
+                cp->path = compile(*predicate.path, namespaces);
+                cp->equals = predicate.equals;
+                s.predicates.push_back(cp);
+            }
+            c->steps.push_back(std::move(s));
+        }
+        return c;
+    }
+
+    // Predicate for nodes in the given namespace
+    struct namespace_matches {
+        typedef bool result_type;
+        bool operator()(Context const& c) const {
+            std::string n(c.name());
+            std::string::size_type colon = n.find(':');
+            auto ns = c.namespace_uri(colon == std::string::npos ? std::string() : n.substr(0, colon));
+            return ns && *ns == *uri;
+        }
+        std::shared_ptr<const std::string> uri;
+    };
+
+    // Predicate for nodes for which a '[...]' holds
+    struct predicate_holds {
+        typedef bool result_type;
+        bool operator()(Context& c) const {
+            return holds(*predicate, c);
+        }
+        std::shared_ptr<const compiled_predicate> predicate;
+    };
+
+    // Predicate for nodes that have the given attribute
+    struct has_attribute {
+        typedef bool result_type;
+        bool operator()(Context const& c) const {
+            for (auto const& a: c.attributes()) {
+                if (a.first == *name) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        std::shared_ptr<const std::string> name;
+    };
+
+    static node_range select(compiled_path const& path, node_range in) {
+        auto step = path.steps.begin();
+        if (path.absolute) {
+            auto i = in.begin();
+            if (i == in.end()) {
+                return in;
+            }
+            Context top(*i);
+            while (!top.is_root() && !top.is_null()) {
+                top.parent();
+            }
+            if (step == path.steps.end()) {
+                in = node_range(singleton(top));
+            } else {
+                // the first step is matched against the top element itself
+                node_range self = filter(*step, node_range(singleton(top)));
+                if (step->axis == query_axis::descendant) {
+                    in = node_range(boost::join(self, filter(*step, node_range(singleton(top) | descendant))));
+                } else {
+                    in = self;
+                }
+                ++step;
+            }
+        }
+        for (; step != path.steps.end(); ++step) {
+            in = filter(*step, along_axis(*step, in));
+        }
+        if (path.result == query_result::attribute) {
+            has_attribute f;
+            f.name = std::make_shared<const std::string>(path.attribute);
+            in = node_range(in | filtered(f));
+        }
+        return in;
+    }
+
+    // the nodes on the axis of the step
+    static node_range along_axis(compiled_step const& step, node_range const& in) {
+        switch (step.axis) {
+        case query_axis::child: return node_range(in | child);
+        case query_axis::descendant: return node_range(in | descendant);
+        case query_axis::parent: return node_range(in | parent);
+        case query_axis::ancestor: return node_range(in | ancestor);
+        case query_axis::self: break;
+        }
+        return in;
+    }
+
+    // removes the nodes that do not match the name test and
+    // predicates of the step
+    static node_range filter(compiled_step const& step, node_range in) {
+        if (!step.any_name) {
+            in = node_range(in | filtered(name_predicate<Context>(step.name)));
+        }
+        if (step.uri) {
+            namespace_matches f;
+            f.uri = step.uri;
+            in = node_range(in | filtered(f));
+        }
+        for (auto const& predicate: step.predicates) {
+            predicate_holds f;
+            f.predicate = predicate;
+            in = node_range(in | filtered(f));
+        }
+        return in;
+    }
+
+    static string_range to_strings(compiled_path const& path, node_range const& nodes) {
+        switch (path.result) {
+        case query_result::attribute: return string_range(nodes | attribute(path.attribute));
+        case query_result::name: return string_range(nodes | name);
+        case query_result::text:
+        case query_result::nodes: break;
+        }
+        return string_range(nodes | text);
+    }
+
+    static bool holds(compiled_predicate const& predicate, Context& c) {
+        node_range nodes = select(*predicate.path, node_range(singleton_ref(c)));
+        if (!predicate.equals) {
+            return nodes.begin() != nodes.end();
+        }
+        for (std::string const& s: to_strings(*predicate.path, nodes)) {
+            if (s == *predicate.equals) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::shared_ptr<const compiled_path> p;
+};
+
+// Implements the pipe operator for compiled queries, gives the nodes
+// selected by the query. E.g. 'range | q' or 'range | where(q)'
+template <typename Range, typename Context>
+typename compiled_query<Context>::node_range
+operator|(Range const& r, compiled_query<Context> const& q)
+{
+    return q.nodes(r);
+}
+
+// enables compiled queries in sub-expressions
+template <typename Context>
+struct is_expr<compiled_query<Context> >: std::true_type {
+};
+
+// absolute queries start from the top of the first entry of the range
+template <typename Context>
+struct is_range_selector<compiled_query<Context> >: std::true_type {
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_COMPILED_QUERY_HPP
@@ -9,10 +9,13 @@
 
 #include <boost/range/adaptor/filtered.hpp>
 #include <boost/range/adaptor/transformed.hpp>
-#include <boost/range/any_range.hpp>
+#include <boost/range/iterator.hpp>
+#include <boost/utility/string_ref.hpp>
+#include "adaptor_traits.hpp"
+#include "erased_range.hpp"
+#include "selector_name.hpp"
 #include "singleton_iterator.hpp"
-#include <deque>
-#include "scopedmap.hpp"
+#include "namespace_policy.hpp"
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
@@ -20,51 +23,82 @@ using namespace boost::adaptors;
 
 
 // a context object holds a node (i.e. pugi::xml_node)
-// and uses an Adaptor to access it
-template <typename Adaptor, typename NodeType = typename Adaptor::node_type>
+// and uses an Adaptor to access it. The Namespaces policy
+// keeps track of the namespace declarations in scope for
+// the node, see namespace_policy.hpp. The optional functions of the
+// Adaptor are used when it defines them, see adaptor_traits.hpp
+template <typename Adaptor, typename NodeType = typename Adaptor::node_type,
+          typename Namespaces = scoped_namespaces<Adaptor> >
 class _context
 {
 public:
-    typedef singleton_iterator<_context<Adaptor> > iterator;
-    typedef singleton_iterator<_context<Adaptor> > const_iterator;
+    typedef singleton_iterator<_context> iterator;
+    typedef singleton_iterator<_context> const_iterator;
     typedef NodeType node_type;
     typedef Adaptor adaptor;
+    typedef Namespaces namespaces_type;
     typedef typename Adaptor::attribute_range AttributeRange;
     typedef typename AttributeRange::iterator AttributeIterator;
 private:
     NodeType node;
-    std::deque<scopedmap<std::string, std::string> > maps;
+    Namespaces namespaces;
+
+    // the versions of the functions below with and without the
+    // optional adaptor functions, chosen by the adaptor_traits
+    template <typename A>
+    static auto raw_name_of(NodeType const& n, std::true_type)
+        -> decltype(A::name_cstr(n)) {
+        return A::name_cstr(n);
+    }
 
-    void build_map(NodeType const& n) {
-        if (Adaptor::is_null(n)) {
-            maps.push_back(scopedmap<std::string, std::string>());
-            return;
-        }
-        build_map(Adaptor::parent(n));
+    template <typename A>
+    static auto raw_name_of(NodeType const& n, std::false_type)
+        -> decltype(A::name(n)) {
+        return A::name(n);
+    }
 
-        push_map(n);
+    static bool has_children_of(NodeType const& n, std::true_type) {
+        return Adaptor::child_count(n) > 0;
     }
 
-    void push_map(NodeType const& n) {
+    static bool has_children_of(NodeType const& n, std::false_type) {
+        return Adaptor::has_children(n);
+    }
 
-        assert(!Adaptor::is_null(n));
+    // without first_element_child and next_element_sibling, the nodes
+    // that node_kind does not give as elements are skipped here
+    static NodeType first_element_child_of(NodeType const& n, std::true_type) {
+        return Adaptor::first_element_child(n);
+    }
 
-        auto namespacePairs = Adaptor::namespace_declarations(n);
+    static NodeType first_element_child_of(NodeType const& n, std::false_type) {
+        return skip_to_element(Adaptor::first_child(n));
+    }
 
-        maps.push_back(maps.back().add(namespacePairs.begin(), namespacePairs.end()));
+    static NodeType next_element_sibling_of(NodeType const& n, std::true_type) {
+        return Adaptor::next_element_sibling(n);
+    }
 
+    static NodeType next_element_sibling_of(NodeType const& n, std::false_type) {
+        return skip_to_element(Adaptor::next_sibling(n));
+    }
 
+    static NodeType skip_to_element(NodeType n) {
+        while (!Adaptor::is_null(n) && Adaptor::node_kind(n) != node_kind_type::element) {
+            n = Adaptor::next_sibling(n);
+        }
+        return n;
     }
 
 public:
     _context& operator=(_context const& other) {
-        maps = other.maps;
+        namespaces = other.namespaces;
         node = other.node;
         return *this;
     }
 
     _context& operator=(_context&& other) {
-        maps = std::move(other.maps);
+        namespaces = std::move(other.namespaces);
         node = std::move(other.node);
         return *this;
     }
@@ -82,15 +116,15 @@ public:
     }
 
     explicit _context(NodeType const& n): node(n) {
-        build_map(n);
+        namespaces.build(n);
     }
 
-    _context(_context const& other): node(other.node), maps(other.maps) {
+    _context(_context const& other): node(other.node), namespaces(other.namespaces) {
     }
 
     _context(_context && other)
         : node(std::move(other.node)),
-          maps(std::move(other.maps)) {
+          namespaces(std::move(other.namespaces)) {
     }
 
     _context() : node(Adaptor::null()) {}
@@ -111,6 +145,12 @@ public:
         return Adaptor::text(node);
     }
 
+    // only available when the adaptor defines text_view,
+    // see view_selector.hpp
+    boost::string_ref text_view() const {
+        return Adaptor::text_view(node);
+    }
+
     bool operator==(_context const& other) const {
         return node == other.node;
     }
@@ -118,23 +158,56 @@ public:
     void first_child() {
         node = Adaptor::first_child(node);
         if (node)
-          push_map(node);
+          namespaces.push(node);
     }
 
     void next_sibling() {
-        maps.pop_back();
+        namespaces.pop(node);
         node = Adaptor::next_sibling(node);
         if (node)
-          push_map(node);
+          namespaces.push(node);
+    }
+
+    // moves to the first child that is an element, and returns false
+    // without moving if there is none. Only available when the adaptor
+    // defines first_element_child or node_kind, see axis_step.hpp
+    bool first_element_child() {
+        NodeType n = first_element_child_of(node, has_element_siblings<Adaptor>());
+        if (Adaptor::is_null(n)) {
+            return false;
+        }
+        node = n;
+        namespaces.push(node);
+        return true;
+    }
+
+    // moves to the next sibling that is an element, as above
+    bool next_element_sibling() {
+        NodeType n = next_element_sibling_of(node, has_element_siblings<Adaptor>());
+        if (Adaptor::is_null(n)) {
+            return false;
+        }
+        namespaces.pop(node);
+        node = n;
+        namespaces.push(node);
+        return true;
+    }
+
+    // moves to the given node, which must be a child of the node. Used
+    // to follow a path known beforehand, e.g. from an index, without
+    // walking the siblings
+    void to_child(NodeType const& child) {
+        node = child;
+        namespaces.push(node);
     }
 
     void parent() {
-        maps.pop_back();
+        namespaces.pop(node);
         node = Adaptor::parent(node);
     }
 
     bool has_children() const {
-        return Adaptor::has_children(node);
+        return has_children_of(node, has_child_count<Adaptor>());
     }
 
     bool has_next_sibling() const {
@@ -145,8 +218,15 @@ public:
         return Adaptor::is_root(node);
     }
 
-    scopedmap<std::string, std::string> const& ns() const {
-        return maps.back();
+    // only available with the default scoped_namespaces policy
+    template <typename N = Namespaces>
+    auto ns() const -> decltype(std::declval<N const&>().map()) {
+        return namespaces.map();
+    }
+
+    // the namespace bound to the given prefix at this node, if any
+    boost::optional<const std::string&> namespace_uri(std::string const& prefix) const {
+        return namespaces.get(node, prefix);
     }
 
     AttributeRange attributes() const {
@@ -157,12 +237,57 @@ public:
         return Adaptor::attribute(node, name);
     }
 
+    // true if the attribute with the given name has the given value,
+    // where a missing attribute has the empty value. Does not copy the
+    // value when the adaptor defines attribute_cstr
+    bool attribute_equals(std::string const& name, std::string const& value) const {
+        return attribute_equals(name, value, has_attribute_cstr<Adaptor>());
+    }
+
+    // only available when the adaptor defines attribute_view,
+    // see view_selector.hpp
+    boost::string_ref attribute_view(std::string const& name) const {
+        return Adaptor::attribute_view(node, name);
+    }
+
     bool is_null() const {
         return Adaptor::is_null(node);
     }
 
     std::string name() const {
-        return node.name();
+        return Adaptor::name(node);
+    }
+
+    // the qualified name as given by the adaptor, without copying it
+    // when the adaptor does not copy or defines name_cstr, see
+    // selector_name.hpp
+    auto raw_name() const
+        -> decltype(raw_name_of<Adaptor>(std::declval<NodeType const&>(), has_name_cstr<Adaptor>())) {
+        return raw_name_of<Adaptor>(node, has_name_cstr<Adaptor>());
+    }
+
+    // true if the local part of the name is the given name. Left to the
+    // adaptor when it defines name_equals
+    bool has_local_name(selector_name const& name) const {
+        return has_local_name(name, has_name_equals<Adaptor>());
+    }
+
+private:
+    bool attribute_equals(std::string const& name, std::string const& value, std::true_type) const {
+        const char* v = Adaptor::attribute_cstr(node, name.c_str());
+        return v ? value == v : value.empty();
+    }
+
+    bool attribute_equals(std::string const& name, std::string const& value, std::false_type) const {
+        return Adaptor::attribute(node, name) == value;
+    }
+
+    bool has_local_name(selector_name const& name, std::true_type) const {
+        return Adaptor::name_equals(node, name.str().data(), name.str().size());
+    }
+
+    bool has_local_name(selector_name const& name, std::false_type) const {
+        return name.matches_local(raw_name());
     }
 
 };
@@ -171,11 +296,12 @@ public:
 /// from any result range from any query to this type which hides
 /// the actual type. This is useful for example as function
 /// parameter types, instead of using a template function everywhere.
+/// See erased_range.hpp for what the type erasure costs.
 template <typename T>
-class range : public boost::any_range<T, boost::forward_traversal_tag, T&, boost::use_default> {
+class range : public erased_range<T> {
 public:
   template<typename ActualRange>
-  range(ActualRange const& other) : boost::any_range<T, boost::forward_traversal_tag, T&, boost::use_default>(other) { }
+  range(ActualRange const& other) : erased_range<T>(other) { }
 };
 
 }}}}
@@ -7,6 +7,8 @@
 #ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_DESCENDANT_ITERATOR
 #define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_DESCENDANT_ITERATOR
 
+#include "axis_step.hpp"
+
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/range/iterator_range.hpp>
 #include <boost/range/adaptor/filtered.hpp>
@@ -16,38 +18,50 @@ namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 // An iterator over a range of context nodes. It is given another range
 // of nodes and iterates through all decendants of all nodes in that
-// other range.
-template <typename ParentIterator>
+// other range. If distinct is set, the nodes in the other range that
+// are inside the subtree of the node before them are skipped, so with
+// the other range in document order, each descendant is visited once
+// and they come in document order. See distinct_descendant. This is a
+// structural join: with the other range in document order, the nodes
+// of it inside the subtree being walked are met by the walk in their
+// order, so each is skipped when the walk reaches it, by comparing the
+// node with the next node of the other range. The cost is the size of
+// the subtrees plus the size of the other range, whatever the depth.
+// Step chooses the nodes that are visited, see axis_step.hpp.
+template <typename ParentIterator, typename Step = all_nodes>
 class descendant_iterator : public boost::iterator_facade<
-        descendant_iterator<ParentIterator>,
+        descendant_iterator<ParentIterator, Step>,
         typename ParentIterator::value_type,
         boost::forward_traversal_tag> {
 private:
     typedef boost::iterator_facade<
-    descendant_iterator<ParentIterator>,
+    descendant_iterator<ParentIterator, Step>,
     typename ParentIterator::value_type,
     boost::forward_traversal_tag> super;
 public:
     descendant_iterator() {}
 
-    descendant_iterator(ParentIterator begin, ParentIterator end) {
+    descendant_iterator(ParentIterator begin, ParentIterator end, bool distinct = false) {
         if (begin != end) {
-            d.reset(new data(std::move(begin), std::move(end), 0));
+            d.reset(new data(std::move(begin), std::move(end), 0, distinct));
+            if (distinct) {
+                start_pending();
+            }
             increment();
         }
     };
 
-    descendant_iterator(descendant_iterator<ParentIterator> const& other){
+    descendant_iterator(descendant_iterator const& other){
         if (other.d) {
             d.reset(new data(*(other.d)));
         }
     }
 
-    descendant_iterator(descendant_iterator<ParentIterator>&& other) {
+    descendant_iterator(descendant_iterator&& other) {
         d = std::move(other.d);
     }
 
-    descendant_iterator& operator=(descendant_iterator<ParentIterator> const& other) {
+    descendant_iterator& operator=(descendant_iterator const& other) {
         if (other.d) {
             d.reset(new data(*(other.d)));
         } else {
@@ -56,26 +70,26 @@ public:
         return *this;
     }
 
-    descendant_iterator& operator=(descendant_iterator<ParentIterator>&& other) {
+    descendant_iterator& operator=(descendant_iterator&& other) {
         d = std::move(other.d);
         return *this;
     }
 
     void increment() {
         if (!d->c->is_null()) {
-            if (d->c->has_children()) {
-                d->c->first_child();
+            if (Step::first_child(*(d->c))) {
                 d->depth++;
+                pass();
                 return;
-            } else if (d->depth > 0 && d->c->has_next_sibling()) {
-                d->c->next_sibling();
+            } else if (d->depth > 0 && Step::next_sibling(*(d->c))) {
+                pass();
                 return;
             } else {
                 while (d->depth > 0) {
                     d->c->parent();
                     d->depth--;
-                    if (d->depth > 0 && d->c->has_next_sibling()) {
-                        d->c->next_sibling();
+                    if (d->depth > 0 && Step::next_sibling(*(d->c))) {
+                        pass();
                         return;
                     }
                 }
@@ -83,10 +97,18 @@ public:
         }
 
         if (d->depth == 0) {
-            ++(d->parent_it);
+            if (d->distinct) {
+                // the nodes before the pending one were inside the subtree
+                d->parent_it = d->pending;
+            } else {
+                ++(d->parent_it);
+            }
             if (d->parent_it != d->parent_end) {
                 d->c.reset(new typename super::value_type(*d->parent_it));
                 d->depth = 0;
+                if (d->distinct) {
+                    start_pending();
+                }
                 increment();
             } else {
                 d.reset();
@@ -109,28 +131,70 @@ public:
         return *(d->c);
     }
 private:
+    typedef typename super::value_type::node_type node_type;
+    typedef typename super::value_type::adaptor adaptor;
+
+    // makes the node after the current one in the other range pending,
+    // skipping those equal to the current one
+    void start_pending() {
+        d->pending = d->parent_it;
+        advance_pending();
+        pass();
+    }
+
+    void advance_pending() {
+        ++(d->pending);
+        d->pending_node = d->pending != d->parent_end
+                ? (*(d->pending)).get_node() : adaptor::null();
+    }
+
+    // skips the pending nodes of the other range that are the node the
+    // walk is at, their descendants are walked already. Only the raw
+    // nodes are compared, so no context is built to find out
+    void pass() {
+        if (!d->distinct) {
+            return;
+        }
+        node_type const& n = d->c->get_node();
+        while (d->pending != d->parent_end && d->pending_node == n) {
+            advance_pending();
+        }
+    }
+
     struct data {
         data(ParentIterator parent_it,
              ParentIterator parent_end,
-             int depth)
+             int depth,
+             bool distinct)
             : parent_it(parent_it),
               parent_end(parent_end),
+              pending(parent_end),
+              pending_node(adaptor::null()),
               c(std::make_shared<typename super::value_type>(*parent_it)),
-              depth(depth) {
+              depth(depth),
+              distinct(distinct) {
         }
 
         data(data const& other)
             : parent_it(other.parent_it),
               parent_end(other.parent_end),
+              pending(other.pending),
+              pending_node(other.pending_node),
               c(std::make_shared<typename super::value_type>(*(other.c))),
-              depth(other.depth)
+              depth(other.depth),
+              distinct(other.distinct)
         {
         }
 
         ParentIterator parent_it;
         ParentIterator parent_end;
+        // with distinct, the next node of the other range that is not
+        // inside the walked part of the subtree, and its raw node
+        ParentIterator pending;
+        node_type pending_node;
         std::shared_ptr<typename super::value_type> c;
         int depth;
+        bool distinct;
     };
 
     std::unique_ptr<data> d;
@@ -146,6 +210,22 @@ make_descendant(Range const& r) {
              descendant_iterator<typename Range::iterator>());
 }
 
+template <typename Range>
+boost::iterator_range<descendant_iterator<typename Range::iterator, element_nodes> >
+make_element_descendant(Range const& r) {
+    return boost::make_iterator_range
+            (descendant_iterator<typename Range::iterator, element_nodes>(r.begin(), r.end()),
+             descendant_iterator<typename Range::iterator, element_nodes>());
+}
+
+template <typename Range>
+boost::iterator_range<descendant_iterator<typename Range::iterator> >
+make_distinct_descendant(Range const& r) {
+    return boost::make_iterator_range
+            (descendant_iterator<typename Range::iterator>(r.begin(), r.end(), true),
+             descendant_iterator<typename Range::iterator>());
+}
+
 }}}}
 
 #endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_DESCENDANT_ITERATOR
@@ -14,7 +14,7 @@
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 struct filtered_descendant {
-    explicit filtered_descendant(std::string s): name(std::move(s)) {
+    explicit filtered_descendant(std::string const& s): name(s) {
     }
 
     filtered_descendant(filtered_descendant&& other)
@@ -25,7 +25,7 @@ struct filtered_descendant {
         : name(other.name) {
     }
 
-    std::string name;
+    selector_name name;
 };
 
 // The type for the decentand selector
@@ -36,6 +36,38 @@ public:
     }
 };
 
+// The name given to the element_descendant selector
+struct filtered_element_descendant {
+    explicit filtered_element_descendant(std::string const& s): name(s) {
+    }
+
+    selector_name name;
+};
+
+// The type for the element_descendant selector
+class _element_descendant {
+public:
+    filtered_element_descendant operator()(std::string name) const {
+        return filtered_element_descendant(name);
+    }
+};
+
+// The name given to the distinct_descendant selector
+struct filtered_distinct_descendant {
+    explicit filtered_distinct_descendant(std::string const& s): name(s) {
+    }
+
+    selector_name name;
+};
+
+// The type for the distinct_descendant selector
+class _distinct_descendant {
+public:
+    filtered_distinct_descendant operator()(std::string name) const {
+        return filtered_distinct_descendant(name);
+    }
+};
+
 namespace {
     /// The descendant selector gives all descendants of all
     /// nodes in the input range, i.e. 'range | descendant'.
@@ -43,6 +75,22 @@ namespace {
     /// name as input, i.e. 'range | descendant("foo")' to get
     /// only the descendants with the name "foo".
     const _descendant descendant;
+
+    /// Like descendant, but gives only the elements, e.g.
+    /// 'range | element_descendant("foo")'. Text, comments and
+    /// processing instructions are skipped by the adaptor, see
+    /// element_child.
+    const _element_descendant element_descendant;
+
+    /// Like descendant, but gives each node once, and in document
+    /// order, when the input range is in document order and some of
+    /// its nodes are inside others, e.g.
+    /// 'range | descendant("a") | distinct_descendant("b")'. The
+    /// subtree of a node is walked once, the input nodes inside it
+    /// are skipped, so nested input costs no more than the subtree.
+    /// For input in another order the nodes may repeat, as with
+    /// descendant.
+    const _distinct_descendant distinct_descendant;
 }
 
 // Implements the pipe operator for the descendant selector
@@ -68,6 +116,52 @@ operator|(Range const& range,
             | boost::adaptors::filtered(name_predicate<typename Range::iterator::reference>(f.name));
 }
 
+// Implements the pipe operator for the element_descendant selector
+// E.g. 'range | element_descendant'
+template <typename Range>
+boost::iterator_range<descendant_iterator<typename Range::iterator, element_nodes> >
+operator|(Range const& range,
+          _element_descendant const&)
+{
+    return make_element_descendant(range);
+}
+
+// Implements the pipe operator for the element_descendant selector
+// filtered on name. E.g. 'range | element_descendant("foo")'
+template <typename Range>
+boost::range_detail::filtered_range
+<name_predicate<typename Range::iterator::reference>,
+ const boost::iterator_range<descendant_iterator<typename Range::iterator, element_nodes> > >
+operator|(Range const& range,
+          filtered_element_descendant f)
+{
+    return make_element_descendant(range)
+            | boost::adaptors::filtered(name_predicate<typename Range::iterator::reference>(f.name));
+}
+
+// Implements the pipe operator for the distinct_descendant selector
+// E.g. 'range | distinct_descendant'
+template <typename Range>
+boost::iterator_range<descendant_iterator<typename Range::iterator> >
+operator|(Range const& range,
+          _distinct_descendant const&)
+{
+    return make_distinct_descendant(range);
+}
+
+// Implements the pipe operator for the distinct_descendant selector
+// filtered on name. E.g. 'range | distinct_descendant("foo")'
+template <typename Range>
+boost::range_detail::filtered_range
+<name_predicate<typename Range::iterator::reference>,
+ const boost::iterator_range<descendant_iterator<typename Range::iterator> > >
+operator|(Range const& range,
+          filtered_distinct_descendant f)
+{
+    return make_distinct_descendant(range)
+            | boost::adaptors::filtered(name_predicate<typename Range::iterator::reference>(f.name));
+}
+
 // enables the descendant selector in sub expressions
 template <>
 struct is_expr<_descendant>: std::true_type {
@@ -78,6 +172,34 @@ template <>
 struct is_expr<filtered_descendant>: std::true_type {
 };
 
+// enables the element_descendant selectors in sub expressions
+template <>
+struct is_expr<_element_descendant>: std::true_type {
+};
+
+template <>
+struct is_expr<filtered_element_descendant>: std::true_type {
+};
+
+// enables the distinct_descendant selectors in sub expressions
+template <>
+struct is_expr<_distinct_descendant>: std::true_type {
+};
+
+template <>
+struct is_expr<filtered_distinct_descendant>: std::true_type {
+};
+
+// the distinct_descendant selectors skip the subtrees already given
+// for earlier entries of the range
+template <>
+struct is_range_selector<_distinct_descendant>: std::true_type {
+};
+
+template <>
+struct is_range_selector<filtered_distinct_descendant>: std::true_type {
+};
+
 
 
 }}}}
@@ -0,0 +1,222 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_DISTINCT_ANCESTOR_ITERATOR
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_DISTINCT_ANCESTOR_ITERATOR
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// An iterator over a range of context nodes. It is given another range
+// of nodes and iterates through the ancestors, or only the parents, of
+// all nodes in that other range, giving each of them once.
+//
+// It keeps the path from the top element to the node before, and for
+// each node climbs only until it reaches that path, so for nodes close
+// to each other, like siblings, the climb is one step. The new part of
+// the path is the ancestors not given before. With the other range in
+// document order they are given top down, which keeps the ancestors in
+// document order. Parents are given when first seen, which is document
+// order when the nodes in the other range are at the same depth, e.g.
+// after child steps. With nodes at different depths a parent may come
+// after the parents of nodes inside it, e.g. with '<a><b><c/></b><c/></a>'
+// the c's give b before a. Giving them in document order would mean
+// holding every parent until no ancestor of it can be a parent any
+// more, which may be the end of the other range.
+template <typename ParentIterator>
+class distinct_ancestor_iterator : public boost::iterator_facade<
+        distinct_ancestor_iterator<ParentIterator>,
+        typename ParentIterator::value_type,
+        boost::forward_traversal_tag> {
+private:
+    typedef boost::iterator_facade<
+    distinct_ancestor_iterator<ParentIterator>,
+    typename ParentIterator::value_type,
+    boost::forward_traversal_tag> super;
+    typedef typename super::value_type context_type;
+    typedef typename context_type::node_type node_type;
+    typedef typename context_type::adaptor adaptor;
+public:
+    distinct_ancestor_iterator() {}
+
+    distinct_ancestor_iterator(ParentIterator begin, ParentIterator end, bool parents_only) {
+        if (begin != end) {
+            d.reset(new data(std::move(begin), std::move(end), parents_only));
+            next_input();
+        }
+    }
+
+    distinct_ancestor_iterator(distinct_ancestor_iterator const& other) {
+        if (other.d) {
+            d.reset(new data(*(other.d)));
+        }
+    }
+
+    distinct_ancestor_iterator(distinct_ancestor_iterator&& other)
+        : d(std::move(other.d)) {
+    }
+
+    distinct_ancestor_iterator& operator=(distinct_ancestor_iterator const& other) {
+        if (other.d) {
+            d.reset(new data(*(other.d)));
+        } else {
+            d.reset();
+        }
+        return *this;
+    }
+
+    distinct_ancestor_iterator& operator=(distinct_ancestor_iterator&& other) {
+        d = std::move(other.d);
+        return *this;
+    }
+
+    void increment() {
+        if (++(d->pos) == d->pending.size()) {
+            next_input();
+        }
+    }
+
+    bool equal(distinct_ancestor_iterator const& other) const {
+        if (!d || !other.d) {
+            return d.get() == other.d.get();
+        }
+        return
+            d->parent_it == other.d->parent_it &&
+            d->pos == other.d->pos &&
+            d->parent_end == other.d->parent_end;
+    }
+
+    typename super::reference dereference() const {
+        return d->pending[d->pos];
+    }
+
+private:
+    // reads nodes from the other range until one of them has ancestors
+    // that are not given yet
+    void next_input() {
+        d->pending.clear();
+        d->pos = 0;
+        while (d->pending.empty()) {
+            if (d->parent_it == d->parent_end) {
+                d.reset();
+                return;
+            }
+            add(*(d->parent_it));
+            ++(d->parent_it);
+        }
+    }
+
+    void add(context_type const& c) {
+        std::vector<node_type>& path = d->path;
+        std::vector<bool>& given = d->given;
+        // the ancestors that are not on the path, bottom up
+        std::vector<node_type>& climbed = d->climbed;
+        climbed.clear();
+        // the node is first taken to be at the depth of the node before,
+        // so each ancestor is compared with the path node at its depth
+        // only. Otherwise the climb reaches the top element, and the
+        // path is compared from the top down. Either way the join is
+        // found in one climb, with no search of the path
+        node_type n = c.get_node();
+        std::size_t kept = 0;
+        bool joined = false;
+        while (!adaptor::is_null(n) && !adaptor::is_root(n)) {
+            n = adaptor::parent(n);
+            if (climbed.size() < path.size() && path[path.size() - 1 - climbed.size()] == n) {
+                kept = path.size() - climbed.size();
+                joined = true;
+                break;
+            }
+            climbed.push_back(n);
+        }
+        if (!joined) {
+            if (climbed.empty()) {
+                // the top element, it has no ancestors
+                return;
+            }
+            while (kept < path.size() && kept < climbed.size() &&
+                   path[kept] == climbed[climbed.size() - 1 - kept]) {
+                ++kept;
+            }
+            climbed.resize(climbed.size() - kept);
+        }
+        path.resize(kept);
+        given.resize(kept);
+        path.insert(path.end(), climbed.rbegin(), climbed.rend());
+        given.resize(path.size(), !d->parents_only);
+
+        if (d->parents_only) {
+            // the parent is the last node on the path
+            if (!given.back()) {
+                given.back() = true;
+                context_type p(c);
+                p.parent();
+                d->pending.push_back(std::move(p));
+            }
+        } else if (!climbed.empty()) {
+            context_type a(c);
+            for (std::size_t i = 0; i < climbed.size(); ++i) {
+                a.parent();
+                d->pending.push_back(a);
+            }
+            std::reverse(d->pending.begin(), d->pending.end());
+        }
+    }
+
+    struct data {
+        data(ParentIterator parent_it,
+             ParentIterator parent_end,
+             bool parents_only)
+            : parent_it(parent_it),
+              parent_end(parent_end),
+              parents_only(parents_only),
+              pos(0) {
+        }
+
+        ParentIterator parent_it;
+        ParentIterator parent_end;
+        bool parents_only;
+        // the ancestors of the node before, from the top element down,
+        // and if they have been given. All have when giving ancestors
+        std::vector<node_type> path;
+        std::vector<bool> given;
+        // the ancestors climbed for the last node read, kept to reuse
+        // the allocation
+        std::vector<node_type> climbed;
+        // the nodes to give for the last node read, and the position
+        // in them
+        std::vector<context_type> pending;
+        std::size_t pos;
+    };
+
+    std::unique_ptr<data> d;
+};
+
+template <typename Range>
+boost::iterator_range<distinct_ancestor_iterator<typename Range::iterator> >
+make_distinct_ancestor(Range const& r) {
+    return boost::make_iterator_range
+            (distinct_ancestor_iterator<typename Range::iterator>(r.begin(), r.end(), false),
+             distinct_ancestor_iterator<typename Range::iterator>());
+}
+
+template <typename Range>
+boost::iterator_range<distinct_ancestor_iterator<typename Range::iterator> >
+make_distinct_parent(Range const& r) {
+    return boost::make_iterator_range
+            (distinct_ancestor_iterator<typename Range::iterator>(r.begin(), r.end(), true),
+             distinct_ancestor_iterator<typename Range::iterator>());
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_DISTINCT_ANCESTOR_ITERATOR
@@ -0,0 +1,341 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ERASED_RANGE_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ERASED_RANGE_HPP
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/optional.hpp>
+#include <boost/range/begin.hpp>
+#include <boost/range/end.hpp>
+#include <boost/range/iterator.hpp>
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// The position in a range of some type, behind a virtual interface
+template <typename T>
+class erased_source {
+public:
+    virtual ~erased_source() {}
+
+    // the entry at the position, or null at the end of the range. It
+    // stays valid until the position is moved
+    virtual T* current() = 0;
+
+    // moves to the next entry and gives it as current does
+    virtual T* next() = 0;
+
+    // copies up to n entries from the position on into out and moves
+    // past them. Returns the number of entries, fewer than n only at the
+    // end of the range
+    virtual std::size_t next(T* out, std::size_t n) = 0;
+
+    // copies the position into the storage if it fits, and on the heap
+    // otherwise
+    virtual erased_source* clone(void* storage, std::size_t size) const = 0;
+
+    // as clone, but moves the position
+    virtual erased_source* move(void* storage, std::size_t size) = 0;
+};
+
+// When the iterator gives references to entries of type T, the entries
+// are used where the iterator has them. Otherwise, e.g. for the strings
+// given by the text selector, the entry at the position is kept here
+template <typename T, typename Iterator>
+class erased_source_impl : public erased_source<T> {
+    typedef std::is_same<typename std::iterator_traits<Iterator>::reference, T&> in_place;
+    struct no_value { };
+
+public:
+    erased_source_impl(Iterator it, Iterator end)
+        : it(std::move(it)), end(std::move(end)) {
+        load(in_place());
+    }
+
+    T* current() override {
+        return it == end ? nullptr : entry(in_place());
+    }
+
+    T* next() override {
+        ++it;
+        load(in_place());
+        return current();
+    }
+
+    std::size_t next(T* out, std::size_t n) override {
+        std::size_t copied = 0;
+        if (n > 0 && it != end) {
+            out[copied++] = take(in_place());
+            ++it;
+        }
+        for (; copied < n && it != end; ++it) {
+            out[copied++] = *it;
+        }
+        load(in_place());
+        return copied;
+    }
+
+    erased_source<T>* clone(void* storage, std::size_t size) const override {
+        return make(storage, size, *this);
+    }
+
+    erased_source<T>* move(void* storage, std::size_t size) override {
+        return make(storage, size, std::move(*this));
+    }
+
+    static erased_source<T>* make(void* storage, std::size_t size, Iterator const& it, Iterator const& end) {
+        return make(storage, size, erased_source_impl(it, end));
+    }
+
+private:
+    template <typename Source>
+    static erased_source<T>* make(void* storage, std::size_t size, Source&& source) {
+        if (sizeof(erased_source_impl) <= size &&
+                alignof(erased_source_impl) <= alignof(std::max_align_t)) {
+            return new (storage) erased_source_impl(std::forward<Source>(source));
+        }
+        return new erased_source_impl(std::forward<Source>(source));
+    }
+
+    T* entry(std::true_type) {
+        return &*it;
+    }
+
+    T* entry(std::false_type) {
+        return &*value;
+    }
+
+    T take(std::true_type) {
+        return *it;
+    }
+
+    T take(std::false_type) {
+        return std::move(*value);
+    }
+
+    void load(std::true_type) {
+    }
+
+    void load(std::false_type) {
+        if (it != end) {
+            value = *it;
+        }
+    }
+
+    Iterator it;
+    Iterator end;
+    typename std::conditional<in_place::value, no_value, boost::optional<T> >::type value;
+};
+
+// The range of some type, kept alive by the ranges and iterators using it
+template <typename T>
+class erased_holder {
+public:
+    virtual ~erased_holder() {}
+
+    // the position at the start of the range, see erased_source::clone
+    virtual erased_source<T>* begin(void* storage, std::size_t size) const = 0;
+};
+
+template <typename T, typename Range>
+class erased_holder_impl : public erased_holder<T> {
+public:
+    explicit erased_holder_impl(Range const& r) : r(r) {
+    }
+
+    erased_source<T>* begin(void* storage, std::size_t size) const override {
+        typedef typename boost::range_iterator<const Range>::type iterator;
+        return erased_source_impl<T, iterator>::make(storage, size, boost::begin(r), boost::end(r));
+    }
+
+private:
+    Range r;
+};
+
+// An iterator over an erased_range. It holds the position in the
+// actual range in a small buffer, so copying it only allocates for
+// large iterators. Dereferencing gives the entry the actual iterator
+// gives, without copying it, when that is a reference to a T, and
+// otherwise a reference to the one entry kept for the position. The
+// actual range is not read ahead of the position, so 'first' and
+// 'exists' read no further than needed. next_batch copies many entries
+// with one virtual call. Iterators from the same range are equal when
+// they have read equally far.
+template <typename T>
+class erased_iterator : public boost::iterator_facade<erased_iterator<T>, T,
+                                                      boost::forward_traversal_tag> {
+public:
+    enum : std::size_t { storage_size = 64 };
+
+    // the end iterator
+    erased_iterator() : source(nullptr), entry(nullptr), index(0) {
+    }
+
+    explicit erased_iterator(std::shared_ptr<const erased_holder<T> > holder)
+        : holder(std::move(holder)), index(0) {
+        source = this->holder->begin(&storage, storage_size);
+        settle();
+    }
+
+    erased_iterator(erased_iterator const& other)
+        : holder(other.holder),
+          source(other.source ? other.source->clone(&storage, storage_size) : nullptr),
+          entry(source ? source->current() : nullptr), index(other.index) {
+    }
+
+    erased_iterator(erased_iterator&& other)
+        : holder(std::move(other.holder)), source(nullptr), entry(nullptr), index(other.index) {
+        take(other);
+    }
+
+    erased_iterator& operator=(erased_iterator const& other) {
+        if (this != &other) {
+            release();
+            holder = other.holder;
+            source = other.source ? other.source->clone(&storage, storage_size) : nullptr;
+            entry = source ? source->current() : nullptr;
+            index = other.index;
+        }
+        return *this;
+    }
+
+    erased_iterator& operator=(erased_iterator&& other) {
+        if (this != &other) {
+            release();
+            holder = std::move(other.holder);
+            index = other.index;
+            take(other);
+        }
+        return *this;
+    }
+
+    ~erased_iterator() {
+        release();
+    }
+
+    // copies up to n entries into out and goes past them, with one
+    // virtual call. Returns the number of entries, fewer than n only at
+    // the end
+    std::size_t next_batch(T* out, std::size_t n) {
+        if (!source) {
+            return 0;
+        }
+        std::size_t copied = source->next(out, n);
+        index += copied;
+        settle();
+        return copied;
+    }
+
+private:
+    friend class boost::iterator_core_access;
+
+    void increment() {
+        ++index;
+        entry = source->next();
+        if (!entry) {
+            release();
+        }
+    }
+
+    bool equal(erased_iterator const& other) const {
+        if (!entry || !other.entry) {
+            return entry == other.entry;
+        }
+        return index == other.index;
+    }
+
+    T& dereference() const {
+        return *entry;
+    }
+
+    // reads the entry at the position, and lets go of the source at
+    // the end
+    void settle() {
+        entry = source->current();
+        if (!entry) {
+            release();
+        }
+    }
+
+    // takes the position of the other iterator, which is left at the end
+    void take(erased_iterator& other) {
+        if (!other.source) {
+            return;
+        }
+        if (static_cast<void*>(other.source) == static_cast<void*>(&other.storage)) {
+            source = other.source->move(&storage, storage_size);
+            other.release();
+            entry = source->current();
+        } else {
+            source = other.source;
+            entry = other.entry;
+            other.source = nullptr;
+            other.entry = nullptr;
+        }
+    }
+
+    void release() {
+        if (source) {
+            if (static_cast<void*>(source) == static_cast<void*>(&storage)) {
+                source->~erased_source<T>();
+            } else {
+                delete source;
+            }
+            source = nullptr;
+        }
+        entry = nullptr;
+    }
+
+    std::shared_ptr<const erased_holder<T> > holder;
+    typename std::aligned_storage<storage_size, alignof(std::max_align_t)>::type storage;
+    erased_source<T>* source;
+    // the entry at the position, null at the end
+    T* entry;
+    // the number of entries before this position
+    std::size_t index;
+};
+
+// A range of entries of type T, which hides the type of the actual
+// range. Copying it is cheap, since the actual range is shared, and
+// is kept alive also by the iterators. See erased_iterator for how the
+// entries are given.
+template <typename T>
+class erased_range {
+public:
+    typedef erased_iterator<T> iterator;
+    typedef erased_iterator<T> const_iterator;
+
+    template <typename ActualRange>
+    erased_range(ActualRange const& other)
+        : holder(std::make_shared<erased_holder_impl<T, ActualRange> >(other)) {
+    }
+
+    iterator begin() const {
+        return iterator(holder);
+    }
+
+    iterator end() const {
+        return iterator();
+    }
+
+    bool empty() const {
+        return begin() == end();
+    }
+
+private:
+    std::shared_ptr<const erased_holder<T> > holder;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_ERASED_RANGE_HPP
@@ -0,0 +1,240 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#pragma once
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_FLAT_SCOPEDMAP_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_FLAT_SCOPEDMAP_HPP
+
+#include <boost/optional.hpp>
+
+#include <deque>
+#include <limits>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <assert.h>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// A scoped map with the same semantics as scopedmap, but stored flat.
+// All scopes added to the same map share one arena: a stack of frames,
+// one for each scope, over a contiguous array of (key-id, value-id)
+// entries. Keys and values are interned once per arena, so adding a
+// scope appends a frame and its entries without allocating once the
+// arena has grown, leaving a scope follows the frame to its parent,
+// and get is a short backward scan through the frames of the scope.
+//
+// Each frame counts the maps referring to it. When the last map of the
+// frame on top of the stack goes away, the stack is truncated down to
+// the frames still in use, so walking a tree and leaving each scope
+// keeps the arena as deep as the walk, not as large as the tree. A map
+// only refers to frames below it, so the frames of the maps in use are
+// never truncated.
+//
+// A map is never changed once made, add and parent give new maps. The
+// counts and the stack are not synchronized: the maps sharing an arena
+// must be copied, released and added to in one thread at a time. get
+// and clone only read, and may be called from several threads as long
+// as no map of the arena is copied, released or added to meanwhile.
+// clone gives a map in an arena of its own, e.g. for each thread.
+template <class K, class V>
+class flat_scopedmap {
+private:
+    static const unsigned none = std::numeric_limits<unsigned>::max();
+
+    struct entry {
+        unsigned key;
+        unsigned value;
+    };
+
+    struct frame {
+        unsigned parent;
+        // the entries of the scope
+        unsigned begin;
+        unsigned end;
+        // the number of maps referring to the frame
+        unsigned refs;
+    };
+
+    struct arena {
+        std::vector<frame> frames;
+        std::vector<entry> entries;
+        std::unordered_map<K, unsigned> key_ids;
+        std::unordered_map<V, unsigned> value_ids;
+        std::deque<K> keys;
+        std::deque<V> values;
+
+        // looks up before inserting, so known keys and values
+        // are not copied
+        unsigned key_id(K const& k) {
+            auto i = key_ids.find(k);
+            if (i != key_ids.end()) {
+                return i->second;
+            }
+            keys.push_back(k);
+            return key_ids.insert(std::make_pair(k, unsigned(keys.size() - 1))).first->second;
+        }
+
+        unsigned value_id(V const& v) {
+            auto i = value_ids.find(v);
+            if (i != value_ids.end()) {
+                return i->second;
+            }
+            values.push_back(v);
+            return value_ids.insert(std::make_pair(v, unsigned(values.size() - 1))).first->second;
+        }
+
+        // drops the frames on top of the stack that no map refers to
+        void truncate() {
+            while (!frames.empty() && frames.back().refs == 0) {
+                entries.resize(frames.back().begin);
+                frames.pop_back();
+            }
+        }
+    };
+
+    std::shared_ptr<arena> a;
+    // index of the frame of this scope, none for the empty map
+    unsigned f;
+
+    flat_scopedmap(std::shared_ptr<arena> a, unsigned f)
+        : a(std::move(a)), f(f) {
+        retain();
+    }
+
+    void retain() {
+        if (f != none) {
+            ++a->frames[f].refs;
+        }
+    }
+
+    void release() {
+        if (f != none && --a->frames[f].refs == 0) {
+            a->truncate();
+        }
+    }
+
+    // pushes a frame for a scope inside the parent frame, the entries
+    // of the scope are appended after it
+    static unsigned open(arena& target, unsigned parent) {
+        unsigned begin = unsigned(target.entries.size());
+        frame fr = {parent, begin, begin, 0};
+        target.frames.push_back(fr);
+        return unsigned(target.frames.size() - 1);
+    }
+
+    static void append(arena& target, K const& k, V const& v) {
+        entry e = {target.key_id(k), target.value_id(v)};
+        target.entries.push_back(e);
+        target.frames.back().end = unsigned(target.entries.size());
+    }
+
+public:
+    flat_scopedmap() : f(none) {
+    }
+
+    flat_scopedmap(flat_scopedmap const& other) : a(other.a), f(other.f) {
+        retain();
+    }
+
+    flat_scopedmap(flat_scopedmap&& other) : a(std::move(other.a)), f(other.f) {
+        other.f = none;
+    }
+
+    flat_scopedmap& operator=(flat_scopedmap const& other) {
+        if (this != &other) {
+            flat_scopedmap copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    flat_scopedmap& operator=(flat_scopedmap&& other) {
+        if (this != &other) {
+            // keeps the arena alive while the frame is released
+            std::shared_ptr<arena> old = std::move(a);
+            unsigned old_f = f;
+            a = std::move(other.a);
+            f = other.f;
+            other.f = none;
+            if (old_f != none && --old->frames[old_f].refs == 0) {
+                old->truncate();
+            }
+        }
+        return *this;
+    }
+
+    ~flat_scopedmap() {
+        release();
+    }
+
+    // returns a new scope inside this one, holding the given pairs
+    template <typename Iterator>
+    flat_scopedmap add(Iterator begin, Iterator end) const {
+        std::shared_ptr<arena> target = a ? a : std::make_shared<arena>();
+        unsigned top = open(*target, f);
+        for (; begin != end; ++begin) {
+            append(*target, begin->first, begin->second);
+        }
+        return flat_scopedmap(std::move(target), top);
+    }
+
+    // returns the scope this scope was added to
+    flat_scopedmap parent() const {
+        assert(f != none);
+        return flat_scopedmap(a, a->frames[f].parent);
+    }
+
+    // returns a map with the same scopes in an arena of its own
+    flat_scopedmap clone() const {
+        if (f == none) {
+            return flat_scopedmap();
+        }
+        std::vector<unsigned> chain;
+        for (unsigned i = f; i != none; i = a->frames[i].parent) {
+            chain.push_back(i);
+        }
+        std::shared_ptr<arena> target = std::make_shared<arena>();
+        target->frames.reserve(chain.size());
+        unsigned top = none;
+        for (auto i = chain.rbegin(); i != chain.rend(); ++i) {
+            frame const& fr = a->frames[*i];
+            top = open(*target, top);
+            for (unsigned j = fr.begin; j != fr.end; ++j) {
+                append(*target, a->keys[a->entries[j].key], a->values[a->entries[j].value]);
+            }
+        }
+        return flat_scopedmap(std::move(target), top);
+    }
+
+    // the number of scopes in the arena, for all the maps sharing it
+    std::size_t arena_size() const {
+        return a ? a->frames.size() : 0;
+    }
+
+    boost::optional<const V&> const get(K const& k) const {
+        if (!a) {
+            return boost::optional<const V&>();
+        }
+        auto i = a->key_ids.find(k);
+        if (i == a->key_ids.end()) {
+            return boost::optional<const V&>();
+        }
+        for (unsigned j = f; j != none; j = a->frames[j].parent) {
+            frame const& fr = a->frames[j];
+            for (unsigned e = fr.end; e != fr.begin; --e) {
+                if (a->entries[e - 1].key == i->second) {
+                    return boost::optional<const V&>(a->values[a->entries[e - 1].value]);
+                }
+            }
+        }
+        return boost::optional<const V&>();
+    }
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_FLAT_SCOPEDMAP_HPP
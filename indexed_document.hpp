@@ -0,0 +1,172 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_INDEXED_DOCUMENT_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_INDEXED_DOCUMENT_HPP
+
+#include <pugixml.hpp>
+
+#include <cstddef>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// Numbers every node below a pugi::xml_node in one pass, so structural
+// questions about the nodes become integer comparisons. A node is
+// identified by its pre-order number, which also is its position in
+// document order. For every node the index keeps the post-order number,
+// the depth below the indexed root, the id of the parent and the id
+// one past the last descendant, so the descendants of a node are the
+// ids between its own id and that end.
+// The index must be rebuilt if the document is modified.
+class indexed_document {
+public:
+    typedef unsigned id_type;
+
+    // the id of nodes that are not in the index. An enumerator, so it
+    // needs no definition outside the class
+    enum : id_type { npos = std::numeric_limits<id_type>::max() };
+
+    explicit indexed_document(pugi::xml_node const& root) {
+        build(root);
+    }
+
+    std::size_t size() const {
+        return nodes.size();
+    }
+
+    // the id of the given node, or npos if it is not below the root
+    id_type id(pugi::xml_node const& n) const {
+        auto i = ids.find(n.internal_object());
+        return i == ids.end() ? id_type(npos) : i->second;
+    }
+
+    // the id of the node of the given context
+    template <typename Context>
+    id_type id_of(Context const& c) const {
+        return id(c.get_node());
+    }
+
+    pugi::xml_node node(id_type id) const {
+        return nodes[id];
+    }
+
+    id_type pre(id_type id) const {
+        return id;
+    }
+
+    id_type post(id_type id) const {
+        return posts[id];
+    }
+
+    unsigned depth(id_type id) const {
+        return depths[id];
+    }
+
+    // the id of the parent, or npos for the root
+    id_type parent(id_type id) const {
+        return parents[id];
+    }
+
+    // one past the id of the last descendant of the node
+    id_type subtree_end(id_type id) const {
+        return ends[id];
+    }
+
+    // true if a is a proper ancestor of d
+    bool is_ancestor(id_type a, id_type d) const {
+        return a < d && posts[d] < posts[a];
+    }
+
+    // true if d is a or a descendant of a
+    bool is_inside(id_type d, id_type a) const {
+        return a <= d && d < ends[a];
+    }
+
+    // true if a comes before b in document order
+    bool precedes(id_type a, id_type b) const {
+        return a < b;
+    }
+
+private:
+    void build(pugi::xml_node const& root) {
+        if (!root) {
+            return;
+        }
+        id_type post_counter = 0;
+        // the nodes on the path from the root to the current node
+        std::vector<id_type> path;
+        pugi::xml_node n = root;
+        for (;;) {
+            id_type id = add(n, path.empty() ? id_type(npos) : path.back(), unsigned(path.size()));
+            if (n.first_child()) {
+                path.push_back(id);
+                n = n.first_child();
+                continue;
+            }
+            finish(id, post_counter);
+            // climb until a node with a next sibling is found
+            while (!path.empty() && !n.next_sibling()) {
+                n = n.parent();
+                finish(path.back(), post_counter);
+                path.pop_back();
+            }
+            if (path.empty()) {
+                return;
+            }
+            n = n.next_sibling();
+        }
+    }
+
+    id_type add(pugi::xml_node const& n, id_type parent, unsigned depth) {
+        id_type id = id_type(nodes.size());
+        nodes.push_back(n);
+        posts.push_back(0);
+        depths.push_back(depth);
+        parents.push_back(parent);
+        ends.push_back(0);
+        ids.insert(std::make_pair(n.internal_object(), id));
+        return id;
+    }
+
+    void finish(id_type id, id_type& post_counter) {
+        posts[id] = post_counter++;
+        ends[id] = id_type(nodes.size());
+    }
+
+    std::vector<pugi::xml_node> nodes;
+    std::vector<id_type> posts;
+    std::vector<unsigned> depths;
+    std::vector<id_type> parents;
+    std::vector<id_type> ends;
+    std::unordered_map<pugi::xml_node_struct*, id_type> ids;
+};
+
+// Orders contexts, or nodes, in document order using an index. Can be
+// given to std::sort, e.g. to sort the results of a query
+class document_order {
+public:
+    explicit document_order(indexed_document const& index) : index(&index) {
+    }
+
+    bool operator()(pugi::xml_node const& a, pugi::xml_node const& b) const {
+        return index->id(a) < index->id(b);
+    }
+
+    template <typename Context>
+    bool operator()(Context const& a, Context const& b) const {
+        return index->id_of(a) < index->id_of(b);
+    }
+
+private:
+    indexed_document const* index;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_INDEXED_DOCUMENT_HPP
@@ -0,0 +1,132 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_MAPPED_DOCUMENT_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_MAPPED_DOCUMENT_HPP
+
+#include <pugixml.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// thrown when a mapped file is not well formed XML
+class mapped_document_error : public std::runtime_error {
+public:
+    mapped_document_error(std::string const& path, pugi::xml_parse_result const& result)
+        : std::runtime_error("Parsing error in " + path + ": " + result.description() +
+                             " at offset " + std::to_string(result.offset)),
+          result(result) {
+    }
+
+    pugi::xml_parse_result result;
+};
+
+// A pugi document parsed in place from a memory mapped file, so the file
+// is not read into a buffer and copied before parsing. The mapping is
+// private, so the parser writes to copies of the pages it changes and
+// the file itself is left as it is. The names and values of the nodes
+// point into the mapping, which is kept as long as the document. Use
+// map_document to share the document with the code holding its nodes,
+// e.g.
+//   auto doc = map_document("birds.xml");
+//   for (auto bird: context(doc->root()) | child("bird")) ...
+// Only available on POSIX systems.
+class mapped_document {
+public:
+    explicit mapped_document(std::string const& path, unsigned options = pugi::parse_default)
+        : data(nullptr), length(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "stat " + path);
+        }
+        length = std::size_t(info.st_size);
+        if (length > 0) {
+            data = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                int error = errno;
+                ::close(fd);
+                data = nullptr;
+                throw std::system_error(error, std::generic_category(), "mmap " + path);
+            }
+        }
+        // the mapping stays valid after the file is closed
+        ::close(fd);
+        if (data) {
+            ::madvise(data, length, MADV_SEQUENTIAL);
+        }
+        pugi::xml_parse_result result = length > 0
+                ? doc.load_buffer_inplace(data, length, options)
+                : doc.load_string("", options);
+        if (!result) {
+            unmap();
+            throw mapped_document_error(path, result);
+        }
+    }
+
+    ~mapped_document() {
+        // the nodes are freed before the text they point to
+        doc.reset();
+        unmap();
+    }
+
+    mapped_document(mapped_document const&) = delete;
+    mapped_document& operator=(mapped_document const&) = delete;
+
+    pugi::xml_document const& document() const {
+        return doc;
+    }
+
+    // the top element, as given to context()
+    pugi::xml_node root() const {
+        return doc.document_element();
+    }
+
+    // the size of the file
+    std::size_t size() const {
+        return length;
+    }
+
+private:
+    void unmap() {
+        if (data) {
+            ::munmap(data, length);
+            data = nullptr;
+        }
+    }
+
+    void* data;
+    std::size_t length;
+    pugi::xml_document doc;
+};
+
+/// Maps and parses the file, see mapped_document. Throws
+/// std::system_error if the file can not be mapped, and
+/// mapped_document_error if it is not well formed
+inline std::shared_ptr<const mapped_document>
+map_document(std::string const& path, unsigned options = pugi::parse_default) {
+    return std::make_shared<const mapped_document>(path, options);
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_MAPPED_DOCUMENT_HPP
@@ -0,0 +1,253 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAME_INDEX_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAME_INDEX_HPP
+
+#include "indexed_document.hpp"
+#include "selector_name.hpp"
+#include "selector_common.hpp"
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// An inverted index from the local name of the nodes, i.e. the name
+// without prefix as matched by descendant("x"), to the ids of the nodes
+// with that name in document order. Since the descendants of a node are
+// the ids between the node and its subtree end in an indexed_document,
+// the descendants with a given name are a binary searched slice of the
+// list for that name.
+class name_index {
+public:
+    typedef indexed_document::id_type id_type;
+    typedef std::vector<id_type> id_list;
+
+    explicit name_index(indexed_document const& document)
+        : doc(&document) {
+        for (id_type id = 0; id < document.size(); ++id) {
+            names[local_name(document.node(id).name())].push_back(id);
+        }
+    }
+
+    indexed_document const& document() const {
+        return *doc;
+    }
+
+    // the ids of the nodes with the given local name, in document order
+    id_list const& nodes(std::string const& name) const {
+        static const id_list none;
+        auto i = names.find(name);
+        return i == names.end() ? none : i->second;
+    }
+
+    // the part of the list with the ids of the descendants of the node
+    static std::pair<id_list::const_iterator, id_list::const_iterator>
+    descendants(id_list const& list, indexed_document const& document, id_type id) {
+        auto begin = std::upper_bound(list.begin(), list.end(), id);
+        auto end = std::lower_bound(begin, list.end(), document.subtree_end(id));
+        return std::make_pair(begin, end);
+    }
+
+private:
+    indexed_document const* doc;
+    std::unordered_map<std::string, id_list> names;
+};
+
+// An iterator over the descendants with a given name of all nodes in
+// another range, using a name_index. Gives the same nodes in the same
+// order as descendant("x"). The context of each result is derived from
+// the one before, or from the input context for the first: it climbs
+// to the lowest common ancestor and goes down the path to the next
+// result, as given by the parent ids of the index. So the namespace
+// scopes are only pushed and popped for the part of the path that
+// changes, and a context is never built from the root. Nodes in the
+// input which are not in the index have no descendants.
+template <typename ParentIterator>
+class indexed_descendant_iterator : public boost::iterator_facade<
+        indexed_descendant_iterator<ParentIterator>,
+        typename ParentIterator::value_type,
+        boost::forward_traversal_tag> {
+private:
+    typedef typename ParentIterator::value_type context_type;
+    typedef name_index::id_type id_type;
+    typedef name_index::id_list::const_iterator position;
+public:
+    // the end iterator
+    indexed_descendant_iterator() {}
+
+    indexed_descendant_iterator(ParentIterator begin, ParentIterator end,
+                                name_index::id_list const& list,
+                                indexed_document const& document) {
+        if (begin != end) {
+            d.reset(new data(std::move(begin), std::move(end), list, document));
+            slice();
+            find_next();
+        }
+    }
+
+    indexed_descendant_iterator(indexed_descendant_iterator const& other) {
+        if (other.d) {
+            d.reset(new data(*(other.d)));
+        }
+    }
+
+    indexed_descendant_iterator(indexed_descendant_iterator&& other)
+        : d(std::move(other.d)) {
+    }
+
+    indexed_descendant_iterator& operator=(indexed_descendant_iterator const& other) {
+        if (other.d) {
+            d.reset(new data(*(other.d)));
+        } else {
+            d.reset();
+        }
+        return *this;
+    }
+
+    indexed_descendant_iterator& operator=(indexed_descendant_iterator&& other) {
+        d = std::move(other.d);
+        return *this;
+    }
+
+    void increment() {
+        ++(d->it);
+        find_next();
+    }
+
+    bool equal(indexed_descendant_iterator const& other) const {
+        if (!d || !other.d) {
+            return d.get() == other.d.get();
+        }
+        return d->parent_it == other.d->parent_it && d->it == other.d->it;
+    }
+
+    context_type& dereference() const {
+        return d->current;
+    }
+
+private:
+    // the descendants of the current input node
+    void slice() {
+        id_type id = d->document->id((*(d->parent_it)).get_node());
+        d->current_id = id;
+        if (id == indexed_document::npos) {
+            d->it = d->end = d->list->end();
+        } else {
+            std::tie(d->it, d->end) = name_index::descendants(*(d->list), *(d->document), id);
+            if (d->it != d->end) {
+                d->current = *(d->parent_it);
+            }
+        }
+    }
+
+    // moves on to the next input node until there is a descendant,
+    // and moves the context to it
+    void find_next() {
+        while (d->it == d->end) {
+            ++(d->parent_it);
+            if (d->parent_it == d->parent_end) {
+                d.reset();
+                return;
+            }
+            slice();
+        }
+        move_to(*(d->it));
+    }
+
+    // moves the context from the node before to the given node, which
+    // is after it in document order and inside the input node
+    void move_to(id_type target) {
+        indexed_document const& document = *(d->document);
+        while (!document.is_inside(target, d->current_id)) {
+            d->current.parent();
+            d->current_id = document.parent(d->current_id);
+        }
+        std::vector<id_type>& path = d->path;
+        path.clear();
+        for (id_type id = target; id != d->current_id; id = document.parent(id)) {
+            path.push_back(id);
+        }
+        for (auto i = path.rbegin(); i != path.rend(); ++i) {
+            d->current.to_child(document.node(*i));
+        }
+        d->current_id = target;
+    }
+
+    struct data {
+        data(ParentIterator parent_it,
+             ParentIterator parent_end,
+             name_index::id_list const& list,
+             indexed_document const& document)
+            : parent_it(std::move(parent_it)),
+              parent_end(std::move(parent_end)),
+              list(&list),
+              document(&document),
+              current_id(indexed_document::npos) {
+        }
+
+        ParentIterator parent_it;
+        ParentIterator parent_end;
+        name_index::id_list const* list;
+        indexed_document const* document;
+        position it;
+        position end;
+        context_type current;
+        // the id of the node of the context
+        id_type current_id;
+        // the nodes below the common ancestor on the way to the next
+        // result
+        std::vector<id_type> path;
+    };
+
+    std::unique_ptr<data> d;
+};
+
+// the descendant selector filtered with an index, holds the ids of
+// the nodes that are selected, see also attribute_index.hpp
+struct indexed_descendant_filter {
+    indexed_descendant_filter(name_index::id_list const& list, indexed_document const& document)
+        : list(&list), document(&document) {
+    }
+
+    name_index::id_list const* list;
+    indexed_document const* document;
+};
+
+/// Selects the descendants with the given name, like descendant("x"),
+/// using a name_index, e.g. 'range | indexed_descendant(names, "x")'.
+/// The index must outlive the results.
+inline indexed_descendant_filter indexed_descendant(name_index const& index, std::string const& name) {
+    return indexed_descendant_filter(index.nodes(name), index.document());
+}
+
+// Implements the pipe operator for the indexed_descendant selector
+template <typename Range>
+boost::iterator_range<indexed_descendant_iterator<typename Range::iterator> >
+operator|(Range const& range, indexed_descendant_filter f)
+{
+    typedef indexed_descendant_iterator<typename Range::iterator> iterator;
+    return boost::make_iterator_range
+            (iterator(range.begin(), range.end(), *f.list, *f.document),
+             iterator());
+}
+
+// enables the indexed_descendant selector in sub-expressions
+template <>
+struct is_expr<indexed_descendant_filter>: std::true_type {
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAME_INDEX_HPP
@@ -7,6 +7,8 @@
 #ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAME_SELECTOR_HPP
 #define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAME_SELECTOR_HPP
 
+#include "selector_name.hpp"
+
 #include <boost/range/adaptor/transformed.hpp>
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
@@ -29,12 +31,7 @@ template<typename Element>
 struct node_to_name {
     typedef std::string result_type;
      std::string operator()(Element element) const {
-        std::string name = element.get_node().name();
-        std::string::size_type colonPosition = name.find(':');
-        if (colonPosition != std::string::npos) {
-            name = name.substr(colonPosition+1);
-        }
-        return name;
+        return local_name(element.raw_name());
     }
 };
 
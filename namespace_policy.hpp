@@ -0,0 +1,323 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAMESPACE_POLICY_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAMESPACE_POLICY_HPP
+
+#include "scopedmap.hpp"
+#include "flat_scopedmap.hpp"
+
+#include <boost/optional.hpp>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// A namespace policy keeps track of the namespace declarations that are
+// in scope for the node of a context. The context calls
+//   build(n)   when it is constructed for the node n,
+//   push(n)    after it has moved to n from its parent or previous sibling,
+//   pop(n)     before it moves away from n to its parent or next sibling,
+//   get(n, p)  to look up the namespace bound to the prefix p at n.
+// The policy is given as the third template argument of _context.
+
+// The default policy. Keeps one scopedmap for each ancestor of the node
+// in a deque, so the maps can be popped when moving up in the tree.
+template <typename Adaptor>
+class scoped_namespaces {
+public:
+    typedef typename Adaptor::node_type node_type;
+
+    void build(node_type const& n) {
+        if (Adaptor::is_null(n)) {
+            maps.push_back(scopedmap<std::string, std::string>());
+            return;
+        }
+        build(Adaptor::parent(n));
+
+        push(n);
+    }
+
+    void push(node_type const& n) {
+        assert(!Adaptor::is_null(n));
+
+        auto namespacePairs = Adaptor::namespace_declarations(n);
+
+        maps.push_back(maps.back().add(namespacePairs.begin(), namespacePairs.end()));
+    }
+
+    void pop(node_type const&) {
+        maps.pop_back();
+    }
+
+    boost::optional<const std::string&>
+    get(node_type const&, std::string const& prefix) const {
+        return maps.back().get(prefix);
+    }
+
+    scopedmap<std::string, std::string> const& map() const {
+        return maps.back();
+    }
+
+private:
+    std::deque<scopedmap<std::string, std::string> > maps;
+};
+
+// A lightweight policy where the state is one shared pointer to the
+// innermost scope that declares namespaces. Scopes are immutable and
+// linked to their parent scope, so copying a context only copies the
+// node and the pointer. Nodes without declarations do not get a scope.
+template <typename Adaptor>
+class linked_namespaces {
+public:
+    typedef typename Adaptor::node_type node_type;
+
+    void build(node_type const& n) {
+        if (Adaptor::is_null(n)) {
+            return;
+        }
+        build(Adaptor::parent(n));
+
+        push(n);
+    }
+
+    void push(node_type const& n) {
+        assert(!Adaptor::is_null(n));
+
+        auto declarations = Adaptor::namespace_declarations(n);
+        if (declarations.begin() == declarations.end()) {
+            return;
+        }
+        std::shared_ptr<scope> s(new scope(n, std::move(top)));
+        s->declarations.assign(declarations.begin(), declarations.end());
+        top = std::move(s);
+    }
+
+    void pop(node_type const& n) {
+        if (top && top->owner == n) {
+            top = top->parent;
+        }
+    }
+
+    boost::optional<const std::string&>
+    get(node_type const&, std::string const& prefix) const {
+        for (scope const* s = top.get(); s; s = s->parent.get()) {
+            for (auto const& declaration: s->declarations) {
+                if (declaration.first == prefix) {
+                    return boost::optional<const std::string&>(declaration.second);
+                }
+            }
+        }
+        return boost::optional<const std::string&>();
+    }
+
+private:
+    struct scope {
+        scope(node_type owner, std::shared_ptr<const scope> parent)
+            : owner(std::move(owner)), parent(std::move(parent)) {
+        }
+
+        // the node that declares the namespaces of this scope
+        node_type owner;
+        std::shared_ptr<const scope> parent;
+        std::vector<std::pair<std::string, std::string> > declarations;
+    };
+
+    std::shared_ptr<const scope> top;
+};
+
+// A policy backed by a flat_scopedmap. A context that has not moved,
+// like the root context queries start from, keeps its scopes in a map
+// that is never changed and is shared by its copies. The first time a
+// context moves it clones the scopes into an arena of its own, which
+// the contexts copied from it during that traversal share. Moving
+// through the tree then pushes and pops frames of that arena without
+// allocating, and the arena shrinks again as the traversal leaves
+// scopes. So queries from one root context may run in several threads,
+// while the contexts of one traversal must be copied and released in
+// one thread at a time, see flat_scopedmap.hpp.
+template <typename Adaptor>
+class flat_namespaces {
+public:
+    typedef typename Adaptor::node_type node_type;
+
+    flat_namespaces() : moved(false) {
+    }
+
+    void build(node_type const& n) {
+        map_type scopes;
+        add_ancestors(scopes, n);
+        built = std::make_shared<const map_type>(std::move(scopes));
+        map = map_type();
+        moved = false;
+    }
+
+    void push(node_type const& n) {
+        assert(!Adaptor::is_null(n));
+
+        start_traversal();
+        auto declarations = Adaptor::namespace_declarations(n);
+
+        map = map.add(declarations.begin(), declarations.end());
+    }
+
+    void pop(node_type const&) {
+        start_traversal();
+        map = map.parent();
+    }
+
+    boost::optional<const std::string&>
+    get(node_type const&, std::string const& prefix) const {
+        if (moved) {
+            return map.get(prefix);
+        }
+        return built ? built->get(prefix) : boost::optional<const std::string&>();
+    }
+
+private:
+    typedef flat_scopedmap<std::string, std::string> map_type;
+
+    static void add_ancestors(map_type& scopes, node_type const& n) {
+        if (Adaptor::is_null(n)) {
+            return;
+        }
+        add_ancestors(scopes, Adaptor::parent(n));
+
+        auto declarations = Adaptor::namespace_declarations(n);
+        scopes = scopes.add(declarations.begin(), declarations.end());
+    }
+
+    void start_traversal() {
+        if (!moved) {
+            if (built) {
+                map = built->clone();
+                built.reset();
+            }
+            moved = true;
+        }
+    }
+
+    // the scopes of a context that has not moved
+    std::shared_ptr<const map_type> built;
+    // the scopes of a context that has moved, in the arena of its
+    // traversal
+    map_type map;
+    bool moved;
+};
+
+// A policy that does no work while traversing. A prefix is resolved the
+// first time it is asked for by walking the ancestors of the node and
+// scanning their declarations. The results are memoized per node, so
+// siblings and descendants of a resolved node are found in one step.
+//
+// The memo belongs to a traversal: a context gets a new memo the first
+// time it moves, and the contexts copied from it while it moves, e.g.
+// the results of one descendant query, share that memo. A context that
+// has not moved, like the root context queries start from, keeps a memo
+// of its own, so queries run from one root context do not share or grow
+// a memo, and the memo goes away with the results of the query. The
+// memo is guarded by a mutex, so contexts sharing it may be used from
+// several threads.
+template <typename Adaptor>
+class lazy_namespaces {
+public:
+    typedef typename Adaptor::node_type node_type;
+
+    lazy_namespaces() : moved(false) {
+    }
+
+    void build(node_type const&) {
+        memo = std::make_shared<memo_type>();
+        moved = false;
+    }
+
+    void push(node_type const&) {
+        start_traversal();
+    }
+
+    void pop(node_type const&) {
+        start_traversal();
+    }
+
+    boost::optional<const std::string&>
+    get(node_type const& n, std::string const& prefix) const {
+        if (!memo) {
+            return boost::optional<const std::string&>();
+        }
+        std::lock_guard<std::mutex> lock(memo->mutex);
+        auto& resolved = memo->resolved[prefix];
+        boost::optional<std::string> const* result = &none();
+        node_type x = n;
+        for (; !Adaptor::is_null(x); x = Adaptor::parent(x)) {
+            auto i = resolved.find(x);
+            if (i != resolved.end()) {
+                result = &i->second;
+                break;
+            }
+            auto declaration = find_declaration(x, prefix);
+            if (declaration) {
+                result = &resolved.insert(std::make_pair(x, std::move(declaration))).first->second;
+                break;
+            }
+        }
+        // memoize the nodes between n and x. The node itself is skipped,
+        // most lookups are for leaves which are only asked for once.
+        // Entries are never changed or removed, so the result stays
+        // valid after the lock is released
+        if (!(n == x)) {
+            for (node_type y = Adaptor::parent(n); !(y == x); y = Adaptor::parent(y)) {
+                resolved.insert(std::make_pair(y, *result));
+            }
+        }
+        return *result ?
+                    boost::optional<const std::string&>(**result) :
+                    boost::optional<const std::string&>();
+    }
+
+private:
+    static boost::optional<std::string> find_declaration(node_type const& n, std::string const& prefix) {
+        for (auto const& declaration: Adaptor::namespace_declarations(n)) {
+            if (declaration.first == prefix) {
+                return declaration.second;
+            }
+        }
+        return boost::optional<std::string>();
+    }
+
+    static boost::optional<std::string> const& none() {
+        static const boost::optional<std::string> n;
+        return n;
+    }
+
+    // the first move of a context starts a traversal with a new memo
+    void start_traversal() {
+        if (!moved) {
+            memo = std::make_shared<memo_type>();
+            moved = true;
+        }
+    }
+
+    struct memo_type {
+        std::mutex mutex;
+        // prefix -> node -> the namespace bound to the prefix at the node
+        std::map<std::string, std::map<node_type, boost::optional<std::string> > > resolved;
+    };
+
+    std::shared_ptr<memo_type> memo;
+    // if the context has moved since it was built, i.e. if the memo
+    // belongs to a traversal
+    bool moved;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NAMESPACE_POLICY_HPP
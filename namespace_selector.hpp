@@ -53,7 +53,7 @@ struct node_to_namespace {
         if (colonPosition != std::string::npos) {
             prefix = name.substr(0,colonPosition);
         }
-        auto ns = element.ns().get(prefix);
+        auto ns = element.namespace_uri(prefix);
         if (ns)
             return *ns;
         else
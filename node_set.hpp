@@ -0,0 +1,180 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NODE_SET_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NODE_SET_HPP
+
+#include "indexed_document.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+/// Sorts the ids of an indexed_document and removes the duplicates,
+/// which puts the nodes in document order.
+inline void sort_unique(std::vector<indexed_document::id_type>& ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+// A set of nodes of an indexed_document, kept as their ids in document
+// order without duplicates, e.g.
+//   indexed_document index(root);
+//   node_set titles(index, context(root) | descendant("title"));
+//   node_set headings = unite(titles, node_set(index, context(root) | descendant("h1")));
+//   for (auto c: headings.contexts<_context<PugiXmlAdaptor> >()) ...
+// Since the ids are ordered, unite, intersect and except are linear
+// merges of the two lists. Unlike 'a || b', which joins the two ranges,
+// the result of unite has each node once, in document order.
+// The index must outlive the set.
+class node_set {
+public:
+    typedef indexed_document::id_type id_type;
+    typedef std::vector<id_type>::const_iterator iterator;
+    typedef iterator const_iterator;
+
+    // the empty set
+    explicit node_set(indexed_document const& index) : index(&index) {
+    }
+
+    // the nodes of the contexts in the range, the nodes not in the index
+    // are left out. The ids are only sorted if they are not already in
+    // document order without duplicates, as given by most selectors
+    template <typename Range>
+    node_set(indexed_document const& index, Range const& contexts) : index(&index) {
+        for (auto const& c: contexts) {
+            id_type id = index.id_of(c);
+            if (id != indexed_document::npos) {
+                ids.push_back(id);
+            }
+        }
+        normalize();
+    }
+
+    // the nodes with the given ids, in any order and with duplicates
+    static node_set from_ids(indexed_document const& index, std::vector<id_type> ids) {
+        node_set s(index);
+        s.ids = std::move(ids);
+        s.normalize();
+        return s;
+    }
+
+    // the ids in document order
+    iterator begin() const {
+        return ids.begin();
+    }
+
+    iterator end() const {
+        return ids.end();
+    }
+
+    std::size_t size() const {
+        return ids.size();
+    }
+
+    bool empty() const {
+        return ids.empty();
+    }
+
+    bool contains(id_type id) const {
+        return std::binary_search(ids.begin(), ids.end(), id);
+    }
+
+    indexed_document const& document() const {
+        return *index;
+    }
+
+    // the contexts of the nodes in document order. Each context is
+    // constructed from its node, which builds its namespace scopes from
+    // the root, so a policy that does little work when built, like
+    // lazy_namespaces, suits it best
+    template <typename Context>
+    std::vector<Context> contexts() const {
+        std::vector<Context> result;
+        result.reserve(ids.size());
+        for (id_type id: ids) {
+            result.push_back(Context(index->node(id)));
+        }
+        return result;
+    }
+
+    bool operator==(node_set const& other) const {
+        return index == other.index && ids == other.ids;
+    }
+
+    bool operator!=(node_set const& other) const {
+        return !(*this == other);
+    }
+
+    /// The nodes in a or b, or both. Throws std::invalid_argument if
+    /// the sets are from different indexes, as do intersect and except.
+    friend node_set unite(node_set const& a, node_set const& b) {
+        node_set result = empty_result(a, b);
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result.ids));
+        return result;
+    }
+
+    /// The nodes in both a and b
+    friend node_set intersect(node_set const& a, node_set const& b) {
+        node_set result = empty_result(a, b);
+        std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result.ids));
+        return result;
+    }
+
+    /// The nodes in a that are not in b
+    friend node_set except(node_set const& a, node_set const& b) {
+        node_set result = empty_result(a, b);
+        std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result.ids));
+        return result;
+    }
+
+private:
+    void normalize() {
+        if (std::adjacent_find(ids.begin(), ids.end(), std::greater_equal<id_type>()) != ids.end()) {
+            sort_unique(ids);
+        }
+    }
+
+    // the empty set for the result of a merge of a and b
+    static node_set empty_result(node_set const& a, node_set const& b) {
+        if (a.index != b.index) {
+            throw std::invalid_argument("node sets from different indexed documents");
+        }
+        return node_set(*a.index);
+    }
+
+    indexed_document const* index;
+    std::vector<id_type> ids;
+};
+
+// the type of the as_node_set selector, holds the index
+struct _as_node_set {
+    explicit _as_node_set(indexed_document const& index) : index(&index) {
+    }
+
+    indexed_document const* index;
+};
+
+/// Collects the nodes of the range into a node_set, e.g.
+/// 'range | as_node_set(index)'
+inline _as_node_set as_node_set(indexed_document const& index) {
+    return _as_node_set(index);
+}
+
+// Implements the pipe operator for the as_node_set selector
+template <typename Range>
+node_set operator|(Range const& range, _as_node_set s) {
+    return node_set(*s.index, range);
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_NODE_SET_HPP
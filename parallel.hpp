@@ -0,0 +1,770 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_PARALLEL_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_PARALLEL_HPP
+
+#include "xpath.hpp"
+
+#include <boost/range/adaptor/filtered.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// Selects parallel evaluation, and the number of threads to use
+// including the calling thread. See evaluate below.
+class parallel_policy {
+public:
+    explicit parallel_policy(unsigned threads = std::thread::hardware_concurrency(),
+                             std::size_t alone_nodes = 4096, std::size_t alone_inputs = 64)
+        : threads(threads > 0 ? threads : 1),
+          alone_nodes(alone_nodes), alone_inputs(alone_inputs) {
+    }
+
+    // e.g. 'evaluate(par(4), ...)'
+    parallel_policy operator()(unsigned n) const {
+        return parallel_policy(n, alone_nodes, alone_inputs);
+    }
+
+    // e.g. 'evaluate(par(4).alone(0, 0), ...)' to use the helpers from
+    // the start
+    parallel_policy alone(std::size_t nodes, std::size_t inputs) const {
+        return parallel_policy(threads, nodes, inputs);
+    }
+
+    unsigned threads;
+    // The number of nodes the calling thread walks for a descendant
+    // selector, or of input nodes it tests for where(), before it asks
+    // for helpers. Evaluations smaller than that run on the calling
+    // thread alone, as waking the helpers would cost more than they save
+    std::size_t alone_nodes;
+    std::size_t alone_inputs;
+};
+
+namespace {
+    /// Parallel evaluation on all hardware threads, e.g.
+    /// 'evaluate(par, range, descendant("x") | where(child("y")))',
+    /// or on a given number of threads with 'par(4)'
+    const parallel_policy par;
+}
+
+namespace parallel_detail {
+
+// the expression that leaves a range as it is, used when the
+// expression given to evaluate is only a descendant selector
+struct identity { };
+
+template <typename Range>
+Range const& operator|(Range const& range, identity) {
+    return range;
+}
+
+template <typename Right>
+Right compose(identity, Right const& right) {
+    return right;
+}
+
+template <typename Left, typename Right>
+piped_expression<Left, Right> compose(Left const& left, Right const& right) {
+    return piped_expression<Left, Right>(left, right);
+}
+
+// Splits an expression like 'descendant("x") | where(...) | text' into
+// its leftmost selector and the rest of the expression
+template <typename Expression>
+struct split_head {
+    typedef Expression head_type;
+    typedef identity tail_type;
+
+    static head_type head(Expression const& e) {
+        return e;
+    }
+
+    static tail_type tail(Expression const&) {
+        return identity();
+    }
+};
+
+template <typename Left, typename Right>
+struct split_head<piped_expression<Left, Right> > {
+    typedef typename split_head<Left>::head_type head_type;
+    typedef decltype(compose(std::declval<typename split_head<Left>::tail_type>(),
+                             std::declval<Right>())) tail_type;
+
+    static head_type head(piped_expression<Left, Right> const& e) {
+        return split_head<Left>::head(e.left);
+    }
+
+    static tail_type tail(piped_expression<Left, Right> const& e) {
+        return compose(split_head<Left>::tail(e.left), e.right);
+    }
+};
+
+// the test a descendant selector applies to each descendant
+template <typename Context>
+struct any_node {
+    typedef bool result_type;
+    bool operator()(Context&) const {
+        return true;
+    }
+};
+
+template <typename Context>
+any_node<Context> head_predicate(_descendant const&) {
+    return any_node<Context>();
+}
+
+template <typename Context>
+name_predicate<Context> head_predicate(filtered_descendant const& f) {
+    return name_predicate<Context>(f.name);
+}
+
+template <typename Context, typename Expression>
+where_predicate<Expression, Context&> head_predicate(_where<Expression> const& w) {
+    return where_predicate<Expression, Context&>(w.e);
+}
+
+template <typename Context, typename Expression>
+where_not_predicate<Expression, Context&> head_predicate(_where_not<Expression> const& w) {
+    return where_not_predicate<Expression, Context&>(w.e);
+}
+
+// how the work is split between the threads: by the subtrees below
+// the input for descendant selectors, and by the input itself for
+// where() and where_not()
+struct split_subtrees { };
+struct split_input { };
+
+inline split_subtrees split_kind(_descendant const&) {
+    return split_subtrees();
+}
+
+inline split_subtrees split_kind(filtered_descendant const&) {
+    return split_subtrees();
+}
+
+template <typename Expression>
+split_input split_kind(_where<Expression> const&) {
+    return split_input();
+}
+
+template <typename Expression>
+split_input split_kind(_where_not<Expression> const&) {
+    return split_input();
+}
+
+// Splits the rest of an expression into the selectors that work on each
+// node by itself, which the workers apply, and the selectors from the
+// first one that needs the whole range, see is_range_selector, which are
+// applied to the joined results of the workers. E.g. 'child("y") |
+// take(1) | text' is split into 'child("y")' and 'take(1) | text'
+template <typename Expression, bool = is_range_selector<Expression>::value>
+struct split_tail {
+    typedef Expression local_type;
+    typedef identity rest_type;
+
+    static local_type local(Expression const& e) {
+        return e;
+    }
+
+    static rest_type rest(Expression const&) {
+        return identity();
+    }
+};
+
+template <typename Expression>
+struct split_tail<Expression, true> {
+    typedef identity local_type;
+    typedef Expression rest_type;
+
+    static local_type local(Expression const&) {
+        return identity();
+    }
+
+    static rest_type rest(Expression const& e) {
+        return e;
+    }
+};
+
+template <typename Left, typename Right>
+struct split_tail<piped_expression<Left, Right>, true> {
+    typedef typename split_tail<Left>::local_type local_type;
+    typedef decltype(compose(std::declval<typename split_tail<Left>::rest_type>(),
+                             std::declval<Right>())) rest_type;
+
+    static local_type local(piped_expression<Left, Right> const& e) {
+        return split_tail<Left>::local(e.left);
+    }
+
+    static rest_type rest(piped_expression<Left, Right> const& e) {
+        return compose(split_tail<Left>::rest(e.left), e.right);
+    }
+};
+
+// The results of the expression for one node, given the test of its
+// leftmost selector and the rest of the expression
+template <typename Context, typename Head, typename Tail>
+struct node_results {
+    typedef decltype(singleton_ref(std::declval<Context&>())
+                     | boost::adaptors::filtered(std::declval<Head const&>())
+                     | std::declval<Tail const&>()) range_type;
+    typedef typename std::decay<decltype(*std::declval<range_type&>().begin())>::type value_type;
+
+    template <typename Output>
+    static void append(Context& c, Head const& head, Tail const& tail, Output output) {
+        auto r = singleton_ref(c) | boost::adaptors::filtered(head) | tail;
+        for (auto i = r.begin(); i != r.end(); ++i) {
+            output(*i);
+        }
+    }
+};
+
+// The threads the evaluations below share, so that an evaluation does
+// not start threads of its own. The pool grows to the largest number of
+// helpers asked for, and its threads are joined at exit
+class worker_pool {
+public:
+    // A job run by the calling thread and by some of the pool threads.
+    // wait() returns once the pool threads that took the job are done
+    // with it, and keeps the others from taking it later. The job must
+    // not throw
+    class batch {
+    public:
+        explicit batch(std::function<void()> job)
+            : job(std::move(job)), running(0), closed(false) {
+        }
+
+        void run() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (closed) {
+                    return;
+                }
+                ++running;
+            }
+            job();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0) {
+                done.notify_all();
+            }
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> lock(mutex);
+            closed = true;
+            done.wait(lock, [this] { return running == 0; });
+        }
+
+    private:
+        std::function<void()> job;
+        std::mutex mutex;
+        std::condition_variable done;
+        unsigned running;
+        bool closed;
+    };
+
+    static worker_pool& instance() {
+        static worker_pool pool;
+        return pool;
+    }
+
+    // gives the job to n of the pool threads
+    std::shared_ptr<batch> start(unsigned n, std::function<void()> job) {
+        std::shared_ptr<batch> b = std::make_shared<batch>(std::move(job));
+        std::lock_guard<std::mutex> lock(mutex);
+        while (threads.size() < n) {
+            threads.push_back(std::thread([this] { work(); }));
+        }
+        for (unsigned i = 0; i < n; ++i) {
+            queue.push_back(b);
+        }
+        ready.notify_all();
+        return b;
+    }
+
+    ~worker_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (std::thread& t: threads) {
+            t.join();
+        }
+    }
+
+private:
+    worker_pool() : stopping(false) {
+    }
+
+    void work() {
+        for (;;) {
+            std::shared_ptr<batch> b;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return !queue.empty() || stopping; });
+                if (queue.empty()) {
+                    return;
+                }
+                b = std::move(queue.front());
+                queue.pop_front();
+            }
+            b->run();
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<std::thread> threads;
+    std::deque<std::shared_ptr<batch> > queue;
+    bool stopping;
+};
+
+// The state shared by the workers of one evaluation of a descendant
+// expression.
+//
+// The descendants of a node are the runs of siblings below it. A task
+// walks a run of siblings and their subtrees, starting from a fresh
+// context for its first node, so no namespace state is shared between
+// threads. While some worker is idle, the walking worker splits the
+// rest of the shallowest run it is in off as a new task, which is the
+// largest piece of work it has left. The results of a task are a list
+// of segments, either values or the results of a task split off at that
+// point, so reading the segments in order gives document order. The
+// calling thread starts alone, see parallel_policy::alone_nodes.
+template <typename Context, typename Head, typename Tail>
+class subtree_evaluation {
+public:
+    typedef typename Context::node_type node_type;
+    typedef typename Context::adaptor adaptor;
+    typedef typename node_results<Context, Head, Tail>::value_type value_type;
+
+    subtree_evaluation(Head head, Tail tail)
+        : head(std::move(head)), tail(std::move(tail)),
+          pending(0), idle(0), queued(0), helpers(0), started(false), alone(0), limit(0) {
+    }
+
+    // adds the descendants of the node as a task
+    void add_root(node_type const& n) {
+        node_type first = adaptor::is_null(n) ? adaptor::null() : adaptor::first_child(n);
+        if (!adaptor::is_null(first)) {
+            roots.push_back(make_task(first));
+        }
+    }
+
+    std::vector<value_type> run(parallel_policy const& policy) {
+        helpers = policy.threads - 1;
+        limit = policy.alone_nodes;
+        if (limit == 0) {
+            start_helpers();
+        }
+        work();
+        if (batch) {
+            batch->wait();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        std::vector<value_type> results;
+        std::size_t n = 0;
+        for (task* t: roots) {
+            n += size(*t);
+        }
+        results.reserve(n);
+        for (task* t: roots) {
+            collect(*t, results);
+        }
+        return results;
+    }
+
+private:
+    struct task;
+
+    // the values are kept in deques, as growing a vector copies the
+    // contexts, which can not be moved without throwing
+    struct segment {
+        segment() : split(nullptr) {}
+        std::deque<value_type> values;
+        // the task with the results that come after the values
+        task* split;
+    };
+
+    struct task {
+        explicit task(node_type start) : start(std::move(start)) {}
+        node_type start;
+        std::vector<segment> segments;
+    };
+
+    // a run of siblings the task is walking
+    struct level {
+        node_type node;
+        // the task the rest of the run has been split off to
+        task* split;
+    };
+
+    task* make_task(node_type const& start) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::unique_ptr<task>(new task(start)));
+        queue.push_back(tasks.back().get());
+        ++pending;
+        ++queued;
+        return tasks.back().get();
+    }
+
+    void work() {
+        for (;;) {
+            task* t;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ++idle;
+                ready.wait(lock, [this] { return !queue.empty() || pending == 0; });
+                --idle;
+                if (queue.empty()) {
+                    return;
+                }
+                // the oldest task, which is the largest
+                t = queue.front();
+                queue.pop_front();
+                --queued;
+            }
+            try {
+                walk(*t);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                ready.notify_all();
+            }
+        }
+    }
+
+    void walk(task& t) {
+        Context c(t.start);
+        std::vector<level> levels;
+        levels.push_back(level{t.start, nullptr});
+        for (;;) {
+            emit(c, t);
+            if (c.has_children()) {
+                c.first_child();
+                levels.push_back(level{c.get_node(), nullptr});
+            } else if (!next(c, levels, t)) {
+                return;
+            }
+            if (!started) {
+                if (++alone >= limit) {
+                    start_helpers();
+                }
+            } else if (idle.load(std::memory_order_relaxed) > queued.load(std::memory_order_relaxed)) {
+                split(levels);
+            }
+        }
+    }
+
+    // only called by the calling thread, which is the only one walking
+    // until then
+    void start_helpers() {
+        started = true;
+        if (helpers > 0) {
+            batch = worker_pool::instance().start(helpers, [this] { work(); });
+        }
+    }
+
+    // moves to the next node after the subtree of c. Returns false
+    // when the run of the task is done
+    bool next(Context& c, std::vector<level>& levels, task& t) {
+        for (;;) {
+            level& l = levels.back();
+            if (l.split) {
+                t.segments.push_back(segment());
+                t.segments.back().split = l.split;
+            } else if (c.has_next_sibling()) {
+                c.next_sibling();
+                l.node = c.get_node();
+                return true;
+            }
+            levels.pop_back();
+            if (levels.empty()) {
+                return false;
+            }
+            c.parent();
+        }
+    }
+
+    // splits the rest of the shallowest run that has more nodes
+    // off as a new task
+    void split(std::vector<level>& levels) {
+        for (level& l: levels) {
+            if (!l.split && adaptor::has_next_sibling(l.node)) {
+                l.split = make_task(adaptor::next_sibling(l.node));
+                ready.notify_one();
+                return;
+            }
+        }
+    }
+
+    void emit(Context& c, task& t) {
+        node_results<Context, Head, Tail>::append(c, head, tail, [&t](value_type const& v) {
+            if (t.segments.empty() || t.segments.back().split) {
+                t.segments.push_back(segment());
+            }
+            t.segments.back().values.push_back(v);
+        });
+    }
+
+    std::size_t size(task& t) {
+        std::size_t n = 0;
+        for (segment& s: t.segments) {
+            n += s.values.size() + (s.split ? size(*s.split) : 0);
+        }
+        return n;
+    }
+
+    void collect(task& t, std::vector<value_type>& results) {
+        for (segment& s: t.segments) {
+            std::move(s.values.begin(), s.values.end(), std::back_inserter(results));
+            if (s.split) {
+                collect(*s.split, results);
+            }
+        }
+    }
+
+    Head head;
+    Tail tail;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::unique_ptr<task> > tasks;
+    std::deque<task*> queue;
+    std::vector<task*> roots;
+    std::size_t pending;
+    std::atomic<unsigned> idle;
+    std::atomic<unsigned> queued;
+    std::exception_ptr error;
+    unsigned helpers;
+    // set before the helpers are started, so they only read it
+    bool started;
+    std::size_t alone;
+    std::size_t limit;
+    std::shared_ptr<worker_pool::batch> batch;
+};
+
+// The evaluation of an expression starting with where() or where_not().
+// The input is cut into chunks, several for each thread so that a chunk
+// with expensive nodes does not keep the others waiting, and the threads
+// take the next chunk from a shared counter. Each input node is tested
+// with a fresh context, and the results of the chunks are joined in the
+// order of the input. The calling thread starts alone, see
+// parallel_policy::alone_inputs.
+template <typename Context, typename Head, typename Tail>
+class input_evaluation {
+public:
+    typedef typename Context::node_type node_type;
+    typedef typename node_results<Context, Head, Tail>::value_type value_type;
+
+    input_evaluation(Head head, Tail tail)
+        : head(std::move(head)), tail(std::move(tail)), next(0),
+          helpers(0), started(false), alone(0), limit(0) {
+    }
+
+    void add_root(node_type const& n) {
+        nodes.push_back(n);
+    }
+
+    std::vector<value_type> run(parallel_policy const& policy) {
+        chunk = std::max<std::size_t>(1, nodes.size() / (policy.threads * 8));
+        chunks.resize((nodes.size() + chunk - 1) / chunk);
+        helpers = chunks.empty() ? 0 : std::min<std::size_t>(policy.threads, chunks.size()) - 1;
+        limit = policy.alone_inputs;
+        if (limit == 0) {
+            start_helpers();
+        }
+        work();
+        if (batch) {
+            batch->wait();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        std::vector<value_type> results;
+        std::size_t n = 0;
+        for (std::deque<value_type>& c: chunks) {
+            n += c.size();
+        }
+        results.reserve(n);
+        for (std::deque<value_type>& c: chunks) {
+            std::move(c.begin(), c.end(), std::back_inserter(results));
+        }
+        return results;
+    }
+
+private:
+    void work() {
+        for (;;) {
+            std::size_t i = next++;
+            if (i >= chunks.size()) {
+                return;
+            }
+            std::deque<value_type>& output = chunks[i];
+            std::size_t end = std::min(nodes.size(), (i + 1) * chunk);
+            try {
+                for (std::size_t n = i * chunk; n < end; ++n) {
+                    Context c(nodes[n]);
+                    node_results<Context, Head, Tail>::append(c, head, tail, [&output](value_type const& v) {
+                        output.push_back(v);
+                    });
+                    if (!started && ++alone >= limit) {
+                        start_helpers();
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    // only called by the calling thread, as for subtree_evaluation
+    void start_helpers() {
+        started = true;
+        if (helpers > 0) {
+            batch = worker_pool::instance().start(helpers, [this] { work(); });
+        }
+    }
+
+    Head head;
+    Tail tail;
+    std::vector<node_type> nodes;
+    std::size_t chunk;
+    // deques for the same reason as in subtree_evaluation
+    std::vector<std::deque<value_type> > chunks;
+    std::atomic<std::size_t> next;
+    std::mutex mutex;
+    std::exception_ptr error;
+    std::size_t helpers;
+    bool started;
+    std::size_t alone;
+    std::size_t limit;
+    std::shared_ptr<worker_pool::batch> batch;
+};
+
+// the evaluation for the way the work is split
+template <typename Context, typename Head, typename Tail, typename Kind>
+struct evaluation_for;
+
+template <typename Context, typename Head, typename Tail>
+struct evaluation_for<Context, Head, Tail, split_subtrees> {
+    typedef subtree_evaluation<Context, Head, Tail> type;
+};
+
+template <typename Context, typename Head, typename Tail>
+struct evaluation_for<Context, Head, Tail, split_input> {
+    typedef input_evaluation<Context, Head, Tail> type;
+};
+
+// the leftmost selector of the expression, its test, the selectors
+// after it the workers apply, and the rest
+template <typename Range, typename Expression>
+struct evaluate_types {
+    typedef typename Range::iterator::value_type context_type;
+    typedef split_head<Expression> split;
+    typedef decltype(head_predicate<context_type>(split::head(std::declval<Expression const&>()))) head_type;
+    typedef split_tail<typename split::tail_type> tail_split;
+    typedef typename tail_split::local_type local_type;
+    typedef typename tail_split::rest_type rest_type;
+    typedef decltype(split_kind(split::head(std::declval<Expression const&>()))) kind;
+    typedef typename evaluation_for<context_type, head_type, local_type, kind>::type evaluation_type;
+    typedef std::vector<typename evaluation_type::value_type> joined_type;
+    typedef boost::iterator_range<typename joined_type::iterator> joined_range;
+    typedef typename std::decay<decltype(*(std::declval<joined_range const&>()
+                                           | std::declval<rest_type const&>()).begin())>::type value_type;
+};
+
+// the results are gathered in a deque first, as growing a vector copies
+// the contexts, which can not be moved without throwing
+template <typename Value, typename Range, typename Expression>
+std::vector<Value> evaluate_sequential(Range const& range, Expression const& expression) {
+    std::deque<Value> gathered;
+    auto r = range | expression;
+    for (auto i = r.begin(); i != r.end(); ++i) {
+        gathered.push_back(*i);
+    }
+    return std::vector<Value>(std::make_move_iterator(gathered.begin()),
+                              std::make_move_iterator(gathered.end()));
+}
+
+// applies the selectors that need the whole range to the joined
+// results of the workers
+template <typename Value, typename Joined>
+std::vector<Value> apply_rest(Joined&& joined, identity, std::true_type) {
+    return std::move(joined);
+}
+
+template <typename Value, typename Joined, typename Rest>
+std::vector<Value> apply_rest(Joined&& joined, Rest const& rest, std::false_type) {
+    return evaluate_sequential<Value>(boost::make_iterator_range(joined), rest);
+}
+
+}
+
+/// Evaluates 'range | expression' on several threads and gives the
+/// results in a vector, in the same order as the sequential evaluation.
+/// The expression must start with a descendant selector, or with
+/// where() or where_not(), e.g.
+/// 'evaluate(par, range, descendant("x") | where(child("y")) | text)' or
+/// 'evaluate(par, range, where(descendant("price") | text_contains("0")))'.
+/// For descendant selectors the subtrees below the nodes of the range
+/// are split between the workers, and idle workers take over the rest
+/// of the sibling runs of busy ones. For where() the range is split in
+/// chunks, which suits ranges of many nodes with expensive predicates.
+/// Every worker uses its own contexts, so any namespace policy can be
+/// used. The selectors after the first one are applied to one node at a
+/// time by the workers, up to the first selector that needs the whole
+/// range, like take(n) or distinct_parent, see is_range_selector. That
+/// selector and the ones after it are applied to the joined results, so
+/// the results are always those of 'range | expression'.
+/// The workers are threads kept between evaluations, and small
+/// evaluations, as well as 'par(1)', run on the calling thread only.
+template <typename Range, typename Expression>
+std::vector<typename parallel_detail::evaluate_types<Range, Expression>::value_type>
+evaluate(parallel_policy const& policy, Range const& range, Expression const& expression)
+{
+    typedef parallel_detail::evaluate_types<Range, Expression> types;
+    typedef typename types::value_type value_type;
+    if (policy.threads == 1) {
+        return parallel_detail::evaluate_sequential<value_type>(range, expression);
+    }
+    typename types::split::tail_type tail = types::split::tail(expression);
+    typename types::evaluation_type e(
+            parallel_detail::head_predicate<typename types::context_type>(types::split::head(expression)),
+            types::tail_split::local(tail));
+    for (auto i = range.begin(); i != range.end(); ++i) {
+        e.add_root((*i).get_node());
+    }
+    return parallel_detail::apply_rest<value_type>(
+            e.run(policy), types::tail_split::rest(tail),
+            std::is_same<typename types::rest_type, parallel_detail::identity>());
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_PARALLEL_HPP
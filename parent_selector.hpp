@@ -9,20 +9,21 @@
 
 #include "selector_common.hpp"
 #include "parent_iterator.hpp"
+#include "distinct_ancestor_iterator.hpp"
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 // represents the parent selector filtered on the name of
 // the parent
 struct filtered_parent {
-    explicit filtered_parent(std::string s): name(std::move(s)) {
+    explicit filtered_parent(std::string const& s): name(s) {
     }
 
     filtered_parent(filtered_parent const& other)
         : name(other.name) {
     }
 
-    std::string name;
+    selector_name name;
 };
 
 // the type of the parent selector object
@@ -33,12 +34,39 @@ public:
     }
 };
 
+// represents the distinct_parent selector filtered on the name of
+// the parent
+struct filtered_distinct_parent {
+    explicit filtered_distinct_parent(std::string const& s): name(s) {
+    }
+
+    selector_name name;
+};
+
+// the type of the distinct_parent selector object
+class _distinct_parent {
+public:
+    filtered_distinct_parent operator()(std::string name) const {
+        return filtered_distinct_parent(name);
+    }
+};
+
 namespace {
     /// The parent selctor object gives the parents of each node
     /// in the input range if used on its own, i.e. 'range | parent'
     /// If given a targen parent name as argument, will give only the
     /// parents with that name, i.e. 'range | parent("foo")'
     const _parent parent;
+
+    /// Like parent, but gives each parent once, e.g.
+    /// 'range | distinct_parent' or 'range | distinct_parent("foo")',
+    /// where parent gives a parent once for each of its children in
+    /// the input. The input should be in document order. The parents
+    /// come in document order when the input nodes are at the same
+    /// depth, and otherwise in the order they are first found, e.g.
+    /// '<a><b><c/></b><c/></a>' | descendant("c") | distinct_parent
+    /// gives b before a.
+    const _distinct_parent distinct_parent;
 }
 
 // Implements the pipe operator for the parent selector. E.g.
@@ -65,6 +93,29 @@ operator|(Range const& range,
 }
 
 
+// Implements the pipe operator for the distinct_parent selector. E.g.
+// 'range | distinct_parent'
+template <typename Range>
+boost::iterator_range<distinct_ancestor_iterator<typename Range::iterator> >
+operator|(Range const& range,
+          _distinct_parent const&)
+{
+    return make_distinct_parent(range);
+}
+
+// Implements the pipe operator for the distinct_parent selector
+// filtered on name. E.g. 'range | distinct_parent("foo")'
+template <typename Range>
+boost::range_detail::filtered_range
+<name_predicate<typename Range::iterator::reference>,
+ const boost::iterator_range<distinct_ancestor_iterator<typename Range::iterator> > >
+operator|(Range const& range,
+          filtered_distinct_parent f)
+{
+    return make_distinct_parent(range)
+            | filtered(name_predicate<typename Range::iterator::reference>(f.name));
+}
+
 // enables the parent selector in sub expressions
 template <>
 struct is_expr<_parent>: std::true_type {
@@ -75,6 +126,24 @@ template <>
 struct is_expr<filtered_parent>: std::true_type {
 };
 
+// enables the distinct_parent selectors in sub expressions
+template <>
+struct is_expr<_distinct_parent>: std::true_type {
+};
+
+template <>
+struct is_expr<filtered_distinct_parent>: std::true_type {
+};
+
+// the distinct_parent selectors remember the parents of the whole range
+template <>
+struct is_range_selector<_distinct_parent>: std::true_type {
+};
+
+template <>
+struct is_range_selector<filtered_distinct_parent>: std::true_type {
+};
+
 
 }}}}
 
@@ -10,6 +10,7 @@
 #include "xpath.hpp"
 #include <pugixml.hpp>
 #include <boost/range.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <sstream>
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
@@ -70,6 +71,24 @@ struct PugiXmlAdaptor {
         return node.next_sibling();
     }
 
+    // the first child, or next sibling, that is an element. Optional,
+    // used by the element_child and element_descendant selectors
+    static pugi::xml_node first_element_child(pugi::xml_node const& node) {
+        pugi::xml_node n = node.first_child();
+        while (n && n.type() != pugi::node_element) {
+            n = n.next_sibling();
+        }
+        return n;
+    }
+
+    static pugi::xml_node next_element_sibling(pugi::xml_node const& node) {
+        pugi::xml_node n = node.next_sibling();
+        while (n && n.type() != pugi::node_element) {
+            n = n.next_sibling();
+        }
+        return n;
+    }
+
     static pugi::xml_node parent(pugi::xml_node const& node) {
         return node.parent();
     }
@@ -93,6 +112,26 @@ struct PugiXmlAdaptor {
         return !node;
     }
 
+    // returns the kind of the given node, see adaptor_traits.hpp.
+    // Optional
+    static node_kind_type node_kind(pugi::xml_node const& node) {
+        switch (node.type()) {
+        case pugi::node_element:
+            return node_kind_type::element;
+        case pugi::node_pcdata:
+        case pugi::node_cdata:
+            return node_kind_type::text;
+        default:
+            return node_kind_type::other;
+        }
+    }
+
+    // returns the qualified name of the given node, e.g. "a:b".
+    // The name is not copied
+    static const char* name(pugi::xml_node const& node) {
+        return node.name();
+    }
+
     // serialises the given node to a string
     static std::string to_text(pugi::xml_node const& node) {
         std::ostringstream ss;
@@ -128,6 +167,28 @@ struct PugiXmlAdaptor {
         return node.child_value();
     }
 
+    // returns the value of the attribute with the given name, pointing
+    // into the document, or null if the node does not have the
+    // attribute. Optional, used by 'attribute(name, value)'
+    static const char* attribute_cstr(pugi::xml_node const& node, const char* name) {
+        pugi::xml_attribute a = node.attribute(name);
+        return a ? a.value() : nullptr;
+    }
+
+    // returns a view of the text content of the given node,
+    // pointing into the document
+    static boost::string_ref text_view(pugi::xml_node const& node) {
+        return node.child_value();
+    }
+
+    // returns a view of the value of the attribute with the given
+    // name, pointing into the document. The view has no data if the
+    // node does not have the attribute
+    static boost::string_ref attribute_view(pugi::xml_node const& node, std::string const& name) {
+        pugi::xml_attribute a = node.attribute(name.c_str());
+        return a ? boost::string_ref(a.value()) : boost::string_ref();
+    }
+
     // returns all the namespace declarations defined as
     // attributes on the given node. I.e. those starting
     // with "xmlns:"
@@ -148,9 +209,17 @@ struct PugiXmlAdaptor {
 };
 
 // constructs a XTpath context node from the pugi::xml_node
-_context<PugiXmlAdaptor> context(pugi::xml_node const &node) {
+inline _context<PugiXmlAdaptor> context(pugi::xml_node const &node) {
     return _context<PugiXmlAdaptor>(node);
 }
+
+// constructs a XTpath context node from the pugi::xml_node which
+// uses the given namespace policy, e.g. 'context<linked_namespaces>(node)'
+template <template <typename> class Namespaces>
+_context<PugiXmlAdaptor, pugi::xml_node, Namespaces<PugiXmlAdaptor> >
+context(pugi::xml_node const &node) {
+    return _context<PugiXmlAdaptor, pugi::xml_node, Namespaces<PugiXmlAdaptor> >(node);
+}
 }}}}
 
 #endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_PUGI_ADAPTOR_HPP
@@ -0,0 +1,130 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_CACHE_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_CACHE_HPP
+
+#include "compiled_query.hpp"
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// The counters of a query_cache
+struct query_cache_statistics {
+    std::size_t hits;
+    std::size_t misses;
+    std::size_t evictions;
+};
+
+// A least recently used cache of compiled queries, keyed by the query
+// string and the namespace bindings it is compiled with. Compiled
+// queries share their plan, so the query returned from get is cheap to
+// copy and stays valid after it has been evicted. The cache may be
+// shared between threads. A query is compiled without holding the lock,
+// so two threads missing on the same string may both compile it, and
+// one of the results is kept.
+template <typename Context>
+class query_cache {
+public:
+    typedef compiled_query<Context> query_type;
+
+    explicit query_cache(std::size_t capacity) : capacity(capacity), counters() {
+    }
+
+    // returns the compiled query for the string, compiling it if it
+    // is not in the cache. Throws as the compiled_query constructor
+    query_type get(std::string const& query,
+                   namespace_bindings const& namespaces = namespace_bindings()) {
+        std::string k = key(query, namespaces);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto i = index.find(k);
+            if (i != index.end()) {
+                ++counters.hits;
+                entries.splice(entries.begin(), entries, i->second);
+                return i->second->second;
+            }
+            ++counters.misses;
+        }
+
+        query_type compiled(query, namespaces);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto i = index.find(k);
+        if (i != index.end()) {
+            entries.splice(entries.begin(), entries, i->second);
+            return i->second->second;
+        }
+        if (capacity == 0) {
+            return compiled;
+        }
+        entries.push_front(std::make_pair(k, compiled));
+        index.insert(std::make_pair(std::move(k), entries.begin()));
+        while (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++counters.evictions;
+        }
+        return compiled;
+    }
+
+    query_cache_statistics statistics() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return counters;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    // removes all queries, the counters are kept
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        index.clear();
+        entries.clear();
+    }
+
+private:
+    // the query followed by the bindings, which are ordered by prefix.
+    // Each part is prefixed by its length, so the key of one query and
+    // set of bindings can not be the key of another, whatever
+    // characters they contain
+    static std::string key(std::string const& query, namespace_bindings const& namespaces) {
+        std::string k;
+        append_part(k, query);
+        for (auto const& binding: namespaces) {
+            append_part(k, binding.first);
+            append_part(k, binding.second);
+        }
+        return k;
+    }
+
+    static void append_part(std::string& k, std::string const& part) {
+        k += std::to_string(part.size());
+        k += ':';
+        k += part;
+    }
+
+    typedef std::list<std::pair<std::string, query_type> > entry_list;
+
+    std::size_t capacity;
+    mutable std::mutex mutex;
+    // most recently used first
+    entry_list entries;
+    std::unordered_map<std::string, typename entry_list::iterator> index;
+    query_cache_statistics counters;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_CACHE_HPP
@@ -0,0 +1,300 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_PARSER_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_PARSER_HPP
+
+#include <boost/optional.hpp>
+
+#include <cctype>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// The syntax tree of a query string. The supported subset of XPath is
+//
+//   path      := ('/' | '//')? step (('/' | '//') step)*
+//   step      := '.' | '..' | axis '::' nametest predicate*
+//              | nametest predicate* | '@' name | 'text()' | 'name()'
+//   axis      := 'child' | 'descendant' | 'parent' | 'ancestor' | 'self'
+//   nametest  := '*' | name | prefix ':' name
+//   predicate := '[' path ('=' literal)? ']'
+//
+// '//' selects descendants, like the descendant selector does, and
+// '@name', 'text()' and 'name()' may only be the last step of a path.
+// Paths starting with '/' are evaluated from the top element of the
+// tree the context node is in.
+
+enum class query_axis {
+    child,
+    descendant,
+    parent,
+    ancestor,
+    self
+};
+
+// what a path gives at the end, the nodes selected by its steps, or
+// strings taken from those nodes
+enum class query_result {
+    nodes,
+    text,
+    attribute,
+    name
+};
+
+struct query_path;
+
+// '[path]' holds if the path selects anything, '[path = "value"]' if
+// any of the selected strings, or the text of any selected node, is
+// equal to the value
+struct query_predicate {
+    std::shared_ptr<const query_path> path;
+    boost::optional<std::string> equals;
+};
+
+struct query_step {
+    query_axis axis;
+    // empty if the step matches any name, i.e. '*'
+    std::string name;
+    std::string prefix;
+    std::vector<query_predicate> predicates;
+};
+
+// prefix -> namespace, for the prefixes used in a query string
+typedef std::map<std::string, std::string> namespace_bindings;
+
+struct query_path {
+    query_path() : absolute(false), result(query_result::nodes) {}
+
+    bool absolute;
+    std::vector<query_step> steps;
+    query_result result;
+    // the name of the attribute, when result is query_result::attribute
+    std::string attribute;
+};
+
+// thrown when a query string can not be parsed. position is the
+// offset in the string where parsing failed
+class query_syntax_error : public std::runtime_error {
+public:
+    query_syntax_error(std::string const& message, std::string::size_type position)
+        : std::runtime_error(message + " at position " + std::to_string(position)),
+          position(position) {
+    }
+
+    std::string::size_type position;
+};
+
+// A recursive descent parser for the grammar above
+class query_parser {
+public:
+    explicit query_parser(std::string const& s) : s(s), i(0) {
+    }
+
+    query_path parse() {
+        query_path p = parse_path(true);
+        skip_space();
+        if (i != s.size()) {
+            fail("unexpected '" + s.substr(i, 1) + "'");
+        }
+        return p;
+    }
+
+private:
+    query_path parse_path(bool allow_absolute) {
+        query_path p;
+        skip_space();
+        query_axis axis = query_axis::child;
+        if (allow_absolute && peek('/')) {
+            p.absolute = true;
+            axis = separator();
+        }
+        for (;;) {
+            skip_space();
+            if (parse_terminal(p)) {
+                if (axis == query_axis::descendant) {
+                    fail("'//' must be followed by an element step");
+                }
+                return p;
+            }
+            p.steps.push_back(parse_step(axis));
+            skip_space();
+            if (!peek('/')) {
+                return p;
+            }
+            axis = separator();
+        }
+    }
+
+    // consumes '/' or '//' and gives the axis of the next step
+    query_axis separator() {
+        ++i;
+        if (peek('/')) {
+            ++i;
+            return query_axis::descendant;
+        }
+        return query_axis::child;
+    }
+
+    bool parse_terminal(query_path& p) {
+        if (peek('@')) {
+            ++i;
+            p.result = query_result::attribute;
+            p.attribute = parse_name();
+            return true;
+        }
+        if (keyword("text()")) {
+            p.result = query_result::text;
+            return true;
+        }
+        if (keyword("name()")) {
+            p.result = query_result::name;
+            return true;
+        }
+        return false;
+    }
+
+    query_step parse_step(query_axis axis) {
+        query_step step;
+        step.axis = axis;
+        if (keyword("..")) {
+            step.axis = join(axis, query_axis::parent);
+            return step;
+        }
+        if (keyword(".")) {
+            step.axis = join(axis, query_axis::self);
+            return step;
+        }
+        std::string::size_type start = i;
+        std::string name = peek('*') ? (++i, std::string("*")) : parse_name();
+        skip_space();
+        if (keyword("::")) {
+            step.axis = join(axis, axis_from_name(name, start));
+            skip_space();
+            name = peek('*') ? (++i, std::string("*")) : parse_name();
+        }
+        std::string::size_type colon = name.find(':');
+        if (colon != std::string::npos) {
+            step.prefix = name.substr(0, colon);
+            name = name.substr(colon + 1);
+        }
+        step.name = name == "*" ? std::string() : name;
+        skip_space();
+        while (peek('[')) {
+            ++i;
+            step.predicates.push_back(parse_predicate());
+        }
+        return step;
+    }
+
+    query_predicate parse_predicate() {
+        query_predicate predicate;
+        predicate.path = std::make_shared<query_path>(parse_path(false));
+        skip_space();
+        if (peek('=')) {
+            ++i;
+            skip_space();
+            predicate.equals = parse_literal();
+            skip_space();
+        }
+        if (!peek(']')) {
+            fail("expected ']'");
+        }
+        ++i;
+        skip_space();
+        return predicate;
+    }
+
+    std::string parse_literal() {
+        if (!peek('\'') && !peek('"')) {
+            fail("expected a string literal");
+        }
+        char quote = s[i++];
+        std::string::size_type end = s.find(quote, i);
+        if (end == std::string::npos) {
+            fail("unterminated string literal");
+        }
+        std::string value = s.substr(i, end - i);
+        i = end + 1;
+        return value;
+    }
+
+    // a name, optionally with a prefix, e.g. 'a' or 'p:a'
+    std::string parse_name() {
+        std::string::size_type start = i;
+        if (i == s.size() || !(std::isalpha(uchar(s[i])) || s[i] == '_')) {
+            fail("expected a name");
+        }
+        while (i < s.size() && (std::isalnum(uchar(s[i])) || s[i] == '_' ||
+                                s[i] == '-' || s[i] == '.' ||
+                                (s[i] == ':' && i + 1 < s.size() && s[i + 1] != ':'))) {
+            ++i;
+        }
+        return s.substr(start, i - start);
+    }
+
+    query_axis axis_from_name(std::string const& name, std::string::size_type position) {
+        if (name == "child") return query_axis::child;
+        if (name == "descendant") return query_axis::descendant;
+        if (name == "parent") return query_axis::parent;
+        if (name == "ancestor") return query_axis::ancestor;
+        if (name == "self") return query_axis::self;
+        i = position;
+        fail("unsupported axis '" + name + "'");
+        return query_axis::child;
+    }
+
+    // an explicit axis may only follow '/', not '//'
+    query_axis join(query_axis separator_axis, query_axis axis) {
+        if (separator_axis == query_axis::descendant) {
+            fail("'//' can not be followed by an axis");
+        }
+        return axis;
+    }
+
+    bool keyword(const char* k) {
+        std::string::size_type n = std::char_traits<char>::length(k);
+        if (s.compare(i, n, k) == 0) {
+            i += n;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c) const {
+        return i < s.size() && s[i] == c;
+    }
+
+    void skip_space() {
+        while (i < s.size() && std::isspace(uchar(s[i]))) {
+            ++i;
+        }
+    }
+
+    static unsigned char uchar(char c) {
+        return static_cast<unsigned char>(c);
+    }
+
+    void fail(std::string const& message) const {
+        throw query_syntax_error(message, i);
+    }
+
+    std::string const& s;
+    std::string::size_type i;
+};
+
+// parses a query string to its syntax tree. Throws query_syntax_error
+inline query_path parse_query(std::string const& s) {
+    return query_parser(s).parse();
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_PARSER_HPP
@@ -0,0 +1,378 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_SET_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_SET_HPP
+
+#include "compiled_query.hpp"
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// Many query strings evaluated together in one walk of the tree, e.g.
+//   query_set<_context<PugiXmlAdaptor> > set;
+//   std::size_t titles = set.add("//title/text()");
+//   std::size_t ids = set.add("item/@id");
+//   auto strings = set.strings(context(node));   // strings[titles], strings[ids]
+//
+// The leading child steps of all queries, up to and including their
+// first descendant step, are merged into one automaton, a trie of
+// states where queries starting with the same steps share states. The
+// walk keeps the states that are active at each node, tests the node
+// only against the steps going out of them, and skips the subtrees
+// where no state is active. The rest of a query, from the step after
+// its first descendant step or its first parent, ancestor or self
+// step, and the final '@name', 'text()' or 'name()', is applied to the
+// nodes found by the automaton with a compiled_query. Queries starting
+// with '/' take part in the walk when it starts at the top element,
+// and are evaluated on their own from other nodes.
+//
+// Each query gives the same results as its compiled_query, in the same
+// order and with the same duplicates. Up to the first descendant step
+// the automaton reaches each node through one path only, and the
+// subtrees searched by the descendant step are disjoint, so it finds
+// the nodes in document order as the compiled_query does. Any step
+// after that is left to the compiled_query, which takes the nodes one
+// by one: e.g. '//a/b' with nested a's gives the b's of the outer a
+// after those of the inner one, and '//a//b' gives a b once for each
+// a it is inside of. The parent and ancestor steps are left to it as
+// well, e.g. '//x/..' gives a parent once for each of its x children.
+// The set may be shared between threads once all queries are added.
+template <typename Context>
+class query_set {
+public:
+    typedef compiled_query<Context> query_type;
+
+    query_set() : states(2) {
+    }
+
+    // adds a query and returns its index in the results. Throws as
+    // the compiled_query constructor
+    std::size_t add(std::string const& query,
+                    namespace_bindings const& namespaces = namespace_bindings()) {
+        return add(parse_query(query), namespaces);
+    }
+
+    std::size_t add(query_path const& path,
+                    namespace_bindings const& namespaces = namespace_bindings()) {
+        // the steps the automaton takes care of, see above
+        std::size_t shared = 0;
+        while (shared < path.steps.size() &&
+               (path.steps[shared].axis == query_axis::child ||
+                path.steps[shared].axis == query_axis::descendant)) {
+            if (path.steps[shared++].axis == query_axis::descendant) {
+                break;
+            }
+        }
+        query_path rest;
+        rest.steps.assign(path.steps.begin() + shared, path.steps.end());
+        rest.result = path.result;
+        rest.attribute = path.attribute;
+        // compiled first, so a bad query leaves the automaton as it was
+        query_type residual(rest, namespaces);
+
+        std::vector<transition> steps;
+        for (std::size_t i = 0; i < shared; ++i) {
+            steps.push_back(make_transition(path.steps[i], namespaces));
+        }
+        boost::optional<query_type> whole;
+        if (path.absolute) {
+            whole = query_type(path, namespaces);
+        }
+        std::size_t s = path.absolute ? absolute_root : relative_root;
+        for (transition& t: steps) {
+            s = follow(s, std::move(t));
+        }
+        states[s].accepts.push_back(queries.size());
+        bool passthrough = rest.steps.empty() && rest.result != query_result::attribute;
+        queries.push_back(entry{passthrough, residual, whole});
+        return queries.size() - 1;
+    }
+
+    // the number of queries
+    std::size_t size() const {
+        return queries.size();
+    }
+
+    // the number of states in the automaton, the queries share states
+    // for the steps they have in common
+    std::size_t state_count() const {
+        return states.size();
+    }
+
+    // the nodes selected by each query, by the index from add
+    std::vector<std::vector<Context> > nodes(Context const& c) const {
+        std::vector<std::vector<Context> > found = walk(c);
+        std::vector<std::vector<Context> > results(queries.size());
+        for (std::size_t q = 0; q < queries.size(); ++q) {
+            entry const& e = queries[q];
+            if (e.whole && !c.is_root()) {
+                auto nodes = e.whole->nodes(c);
+                results[q].assign(nodes.begin(), nodes.end());
+            } else if (e.passthrough) {
+                results[q].swap(found[q]);
+            } else {
+                auto nodes = e.rest.nodes(found[q]);
+                results[q].assign(nodes.begin(), nodes.end());
+            }
+        }
+        return results;
+    }
+
+    // the strings given by each query, see compiled_query::strings
+    std::vector<std::vector<std::string> > strings(Context const& c) const {
+        std::vector<std::vector<Context> > found = walk(c);
+        std::vector<std::vector<std::string> > results(queries.size());
+        for (std::size_t q = 0; q < queries.size(); ++q) {
+            entry const& e = queries[q];
+            auto strings = e.whole && !c.is_root() ? e.whole->strings(c) : e.rest.strings(found[q]);
+            results[q].assign(strings.begin(), strings.end());
+        }
+        return results;
+    }
+
+private:
+    // a step out of a state
+    struct transition {
+        query_axis axis;
+        bool any_name;
+        selector_name name;
+        // the namespace the node must be in, if the step has a prefix
+        bool has_uri;
+        std::string uri;
+        // the paths in '[...]' with the value they must be equal to, if any
+        std::vector<std::pair<query_type, boost::optional<std::string> > > predicates;
+        std::size_t target;
+
+        // steps without predicates are shared by equal steps
+        bool same_step(transition const& other) const {
+            return predicates.empty() && other.predicates.empty() &&
+                    axis == other.axis && any_name == other.any_name &&
+                    name == other.name && has_uri == other.has_uri && uri == other.uri;
+        }
+    };
+
+    struct state {
+        std::vector<transition> child_steps;
+        std::vector<transition> descendant_steps;
+        // the queries whose steps end in this state
+        std::vector<std::size_t> accepts;
+    };
+
+    struct entry {
+        // true if the nodes found by the automaton are the result
+        bool passthrough;
+        // the rest of the query after the steps of the automaton
+        query_type rest;
+        // the whole query, if it is absolute
+        boost::optional<query_type> whole;
+    };
+
+    // the states the relative and the absolute queries start from
+    enum : std::size_t { relative_root = 0, absolute_root = 1 };
+
+    // the states active for the children of a node
+    struct level {
+        std::vector<std::size_t> direct;
+        // the size of the inherited states before this level
+        std::size_t inherited_size;
+    };
+
+    static transition make_transition(query_step const& step, namespace_bindings const& namespaces) {
+        transition t;
+        t.axis = step.axis;
+        t.any_name = step.name.empty();
+        if (!t.any_name) {
+            t.name = selector_name(step.name);
+        }
+        t.has_uri = !step.prefix.empty();
+        if (t.has_uri) {
+            auto i = namespaces.find(step.prefix);
+            if (i == namespaces.end()) {
+                throw std::invalid_argument("unbound namespace prefix '" + step.prefix + "'");
+            }
+            t.uri = i->second;
+        }
+        for (query_predicate const& p: step.predicates) {
+            t.predicates.push_back(std::make_pair(query_type(*p.path, namespaces), p.equals));
+        }
+        return t;
+    }
+
+    // the state reached from s with the step, added if it is new
+    std::size_t follow(std::size_t s, transition t) {
+        std::vector<transition>& out = t.axis == query_axis::child
+                ? states[s].child_steps : states[s].descendant_steps;
+        for (transition const& existing: out) {
+            if (existing.same_step(t)) {
+                return existing.target;
+            }
+        }
+        t.target = states.size();
+        states.push_back(state());
+        // states may have moved
+        std::vector<transition>& moved = t.axis == query_axis::child
+                ? states[s].child_steps : states[s].descendant_steps;
+        moved.push_back(std::move(t));
+        return states.size() - 1;
+    }
+
+    static bool matches(transition const& t, Context& c) {
+        if (!t.any_name && !c.has_local_name(t.name)) {
+            return false;
+        }
+        if (t.has_uri) {
+            std::string n(c.name());
+            std::string::size_type colon = n.find(':');
+            auto ns = c.namespace_uri(colon == std::string::npos ? std::string() : n.substr(0, colon));
+            if (!ns || *ns != t.uri) {
+                return false;
+            }
+        }
+        for (auto const& p: t.predicates) {
+            if (!p.second) {
+                auto nodes = p.first.nodes(singleton_ref(c));
+                if (nodes.begin() == nodes.end()) {
+                    return false;
+                }
+            } else {
+                bool equal = false;
+                for (std::string const& s: p.first.strings(singleton_ref(c))) {
+                    if (s == *p.second) {
+                        equal = true;
+                        break;
+                    }
+                }
+                if (!equal) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // The walk. For every node the states entered at it are found by
+    // testing the child steps of the states entered at its parent, and
+    // the descendant steps of the states entered at any ancestor. Those
+    // are kept once each in 'inherited', with a count of how many
+    // levels have added them
+    std::vector<std::vector<Context> > walk(Context const& top) const {
+        std::vector<std::vector<Context> > found(queries.size());
+        std::vector<std::size_t> inherited;
+        std::vector<unsigned> inherited_count(states.size(), 0);
+        // the last node each state was entered at, to enter it once
+        std::vector<std::size_t> entered(states.size(), 0);
+        std::size_t serial = 1;
+        std::vector<std::size_t> direct;
+
+        Context c(top);
+        std::vector<level> levels;
+        auto enter = [&](std::size_t s) {
+            if (entered[s] != serial) {
+                entered[s] = serial;
+                direct.push_back(s);
+                for (std::size_t q: states[s].accepts) {
+                    found[q].push_back(c);
+                }
+            }
+        };
+        // pushes the level for the children of c
+        auto push_level = [&](std::size_t depth) {
+            if (levels.size() == depth) {
+                levels.push_back(level());
+            }
+            level& l = levels[depth];
+            l.direct.swap(direct);
+            l.inherited_size = inherited.size();
+            for (std::size_t s: l.direct) {
+                if (!states[s].descendant_steps.empty() && inherited_count[s]++ == 0) {
+                    inherited.push_back(s);
+                }
+            }
+        };
+        auto pop_level = [&](std::size_t depth) {
+            level& l = levels[depth];
+            for (std::size_t s: l.direct) {
+                if (!states[s].descendant_steps.empty()) {
+                    --inherited_count[s];
+                }
+            }
+            inherited.resize(l.inherited_size);
+        };
+
+        enter(relative_root);
+        if (c.is_root()) {
+            // the absolute queries start above the top element, so their
+            // first step is matched against the top element itself
+            for (std::size_t q: states[absolute_root].accepts) {
+                found[q].push_back(c);
+            }
+            for (transition const& t: states[absolute_root].child_steps) {
+                if (matches(t, c)) {
+                    enter(t.target);
+                }
+            }
+            for (transition const& t: states[absolute_root].descendant_steps) {
+                if (matches(t, c)) {
+                    enter(t.target);
+                }
+            }
+            if (!states[absolute_root].descendant_steps.empty()) {
+                inherited.push_back(absolute_root);
+                ++inherited_count[absolute_root];
+            }
+        }
+        if (queries.empty() || !c.has_children()) {
+            return found;
+        }
+        push_level(0);
+        std::size_t depth = 1;
+        c.first_child();
+        for (;;) {
+            ++serial;
+            direct.clear();
+            for (std::size_t s: levels[depth - 1].direct) {
+                for (transition const& t: states[s].child_steps) {
+                    if (matches(t, c)) {
+                        enter(t.target);
+                    }
+                }
+            }
+            for (std::size_t s: inherited) {
+                for (transition const& t: states[s].descendant_steps) {
+                    if (matches(t, c)) {
+                        enter(t.target);
+                    }
+                }
+            }
+            if (c.has_children() && (!direct.empty() || !inherited.empty())) {
+                push_level(depth++);
+                c.first_child();
+                continue;
+            }
+            while (!c.has_next_sibling()) {
+                pop_level(--depth);
+                if (depth == 0) {
+                    return found;
+                }
+                c.parent();
+            }
+            c.next_sibling();
+        }
+    }
+
+    std::vector<state> states;
+    std::vector<entry> queries;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_QUERY_SET_HPP
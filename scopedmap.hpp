@@ -13,6 +13,7 @@
 #include <boost/optional.hpp>
 
 #include <unordered_map>
+#include <vector>
 #include <algorithm>
 #include <memory>
 #include <assert.h>
@@ -7,41 +7,35 @@
 #ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SELECTOR_COMMON_HPP
 #define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SELECTOR_COMMON_HPP
 
+#include "selector_name.hpp"
+
 #include <iostream>
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
 
-// A predicate for filtering on node names. Used in several places
+// A predicate for filtering on node names. Used in several places.
+// The name is allocated when the selector is made and shared by its
+// copies, so copying the predicate and matching a node do not allocate
 template <typename Input>
 class name_predicate {
 public:
     bool operator()(Input& i) const {
-        std::string n(i.name());
-        std::string::size_type colonPosition = n.find(':');
-        if (colonPosition != std::string::npos) {
-            n = n.substr(colonPosition+1);
-        }
-        return std::string(n) == name;
-    }
-
-    name_predicate(name_predicate const& other)
-        : name(other.name) {
+        return i.has_local_name(name);
     }
 
-    name_predicate& operator=(name_predicate const& other) {
-        name = other.name;
-        return *this;
+    explicit name_predicate(std::string const& name)
+        : name(name) {
     }
 
-    explicit name_predicate(std::string name)
+    explicit name_predicate(selector_name name)
         : name(name) {
     }
 
     name_predicate() {}
 
 private:
-    std::string name;
+    selector_name name;
 
 };
 
@@ -52,6 +46,15 @@ template <typename T>
 struct is_expr: public std::false_type {
 };
 
+// Specialized to inherit std::true_type for the selectors that give a
+// result for the range as a whole, rather than the results for each
+// entry one after the other, e.g. take(n) and distinct_parent. Such
+// selectors can not be applied to parts of a range on their own, see
+// parallel.hpp
+template <typename T>
+struct is_range_selector: public std::false_type {
+};
+
 }}}}
 
 #endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SELECTOR_COMMON_HPP
@@ -0,0 +1,77 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SELECTOR_NAME_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SELECTOR_NAME_HPP
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// returns the part of a qualified name after the prefix, i.e. "b"
+// for "a:b". Points into the given name, nothing is copied
+inline const char* local_name(const char* qname) {
+    const char* colon = std::strchr(qname, ':');
+    return colon ? colon + 1 : qname;
+}
+
+inline const char* local_name(std::string const& qname) {
+    return local_name(qname.c_str());
+}
+
+// The name a selector like child("foo") matches, kept by the selector
+// or compiled query itself. The name is allocated once when the
+// selector is made and shared by its copies, so copying the selector
+// for each iterator and matching a node do not allocate. It is matched
+// against the raw names given by the adaptor without building any
+// strings, and is released with the last selector using it.
+class selector_name {
+public:
+    selector_name() {
+    }
+
+    explicit selector_name(std::string const& name)
+        : value(std::make_shared<const std::string>(name)) {
+    }
+
+    std::string const& str() const {
+        return value ? *value : empty();
+    }
+
+    // true if the local part of the qualified name is this name
+    bool matches_local(const char* qname) const {
+        std::string const& name = str();
+        const char* local = local_name(qname);
+        return std::strlen(local) == name.size() &&
+                std::memcmp(local, name.data(), name.size()) == 0;
+    }
+
+    bool matches_local(std::string const& qname) const {
+        return matches_local(qname.c_str());
+    }
+
+    bool operator==(selector_name const& other) const {
+        return value == other.value || str() == other.str();
+    }
+
+    bool operator!=(selector_name const& other) const {
+        return !(*this == other);
+    }
+
+private:
+    static std::string const& empty() {
+        static const std::string e;
+        return e;
+    }
+
+    std::shared_ptr<const std::string> value;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SELECTOR_NAME_HPP
@@ -71,6 +71,45 @@ singleton(Element&& n) {
 
 }
 
+// An iterator over a single node it does not own. Used where a node
+// only has to be seen as a range for a moment, e.g. in the predicates
+// of where(), without copying it to the heap as singleton does.
+template <typename Element>
+class singleton_ref_iterator : public boost::iterator_facade<singleton_ref_iterator<Element>,
+       Element, boost::forward_traversal_tag> {
+public:
+    singleton_ref_iterator() : context(nullptr) {}
+
+    explicit singleton_ref_iterator(Element& context)
+        : context(&context) {}
+
+private:
+    friend class boost::iterator_core_access;
+
+    void increment() {
+        context = nullptr;
+    }
+
+    bool equal(singleton_ref_iterator const& other) const {
+        return this->context == other.context;
+    }
+
+    Element& dereference() const {
+        return *context;
+    }
+
+    Element* context;
+};
+
+// the given node as a range. The node must outlive the range
+template <typename Element>
+boost::iterator_range<singleton_ref_iterator<Element> >
+singleton_ref(Element& n) {
+    return boost::make_iterator_range
+            (singleton_ref_iterator<Element>(n),
+             singleton_ref_iterator<Element>());
+}
+
 }}}}
 
 #endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_SINGLETON_ITERATOR
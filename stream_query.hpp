@@ -0,0 +1,331 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_STREAM_QUERY_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_STREAM_QUERY_HPP
+
+#include "query_parser.hpp"
+#include "stream_tokenizer.hpp"
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// A query string evaluated while XML is read from a stream, for
+// documents too large to load into a DOM, e.g.
+//   stream_query q("//item[@kind='b']/@id");
+//   q.run(file, [](std::string const& id) { ... });
+//
+// Only the forward part of the query language is supported: child and
+// descendant steps, predicates on attributes like '[@a]' and '[@a='v']',
+// and a final '@name', 'text()' or 'name()'. The constructor throws
+// std::invalid_argument for other queries. The query is evaluated from
+// the top element, like a compiled_query given the top element, except
+// that name tests only match elements. 'text()' and queries without a
+// final step give the first text in the element, like the text
+// selector does.
+//
+// Each selected node gives one result, in document order. That is not
+// always what the compiled_query gives: it takes the nodes of a step one
+// by one, so on nested elements it may give a node again for each path
+// to it, and the nodes found from an outer element before those from an
+// inner one, e.g. with '<a><a><b/></a><b/></a>' '//a//b' gives the inner
+// b twice, and '//a/b' gives the outer a's b first. The strings are the
+// same when the nodes matched by each step are not nested in each other.
+// The tokenizer keeps the path of open elements, and the query the
+// states active on that path, so that part of the memory use is
+// bounded by the depth of the document.
+//
+// The results are given in document order, each as soon as it and all
+// results before it are complete. The result for an element selected
+// with 'text()' or without a final step is its first text, which may
+// come after any number of its descendants, e.g. '<b><c/>text</b>'. So
+// when such an element is selected, the results found inside it are
+// held until its first text is read, or until it ends if it has no
+// text. Those held results are the rest of the memory use, and can be
+// the whole document for e.g. '//*' on an element without text of its
+// own. Queries whose selected elements are not nested, like
+// '//item/text()' on items that do not contain items, or queries with
+// '@name' or 'name()', hold nothing.
+class stream_query {
+public:
+    explicit stream_query(std::string const& query,
+                          namespace_bindings const& namespaces = namespace_bindings())
+        : stream_query(parse_query(query), namespaces) {
+    }
+
+    explicit stream_query(query_path const& path,
+                          namespace_bindings const& namespaces = namespace_bindings())
+        : absolute(path.absolute), result(path.result), attribute(path.attribute) {
+        for (query_step const& s: path.steps) {
+            steps.push_back(compile(s, namespaces));
+        }
+    }
+
+    // reads the document from the stream and calls f with every result
+    // as it is found. Returns the number of results. Throws
+    // stream_syntax_error if the input is not well formed
+    template <typename Callback>
+    std::size_t run(std::istream& in, Callback f) const {
+        evaluation e(*this);
+        stream_tokenizer tokenizer(in);
+        stream_event event;
+        std::size_t count = 0;
+        auto output = [&](std::string const& s) {
+            ++count;
+            f(s);
+        };
+        while (tokenizer.next(event)) {
+            switch (event.kind) {
+            case stream_event::start_tag: e.start(event); break;
+            case stream_event::characters: e.text(event.text); break;
+            case stream_event::end_tag: e.end(); break;
+            }
+            e.flush(output);
+        }
+        return count;
+    }
+
+    // all results of the query on the document in the stream
+    std::vector<std::string> strings(std::istream& in) const {
+        std::vector<std::string> results;
+        run(in, [&results](std::string const& s) { results.push_back(s); });
+        return results;
+    }
+
+private:
+    struct step {
+        query_axis axis;
+        bool any_name;
+        std::string name;
+        // the namespace the element must be in, if the step has a prefix
+        bool has_uri;
+        std::string uri;
+        // the attributes the element must have, with the values they
+        // must be equal to, if any
+        std::vector<std::pair<std::string, boost::optional<std::string> > > attributes;
+    };
+
+    static step compile(query_step const& s, namespace_bindings const& namespaces) {
+        if (s.axis != query_axis::child && s.axis != query_axis::descendant) {
+            throw std::invalid_argument("stream queries support only child and descendant steps");
+        }
+        step c;
+        c.axis = s.axis;
+        c.any_name = s.name.empty();
+        c.name = s.name;
+        c.has_uri = !s.prefix.empty();
+        if (c.has_uri) {
+            auto i = namespaces.find(s.prefix);
+            if (i == namespaces.end()) {
+                throw std::invalid_argument("unbound namespace prefix '" + s.prefix + "'");
+            }
+            c.uri = i->second;
+        }
+        for (query_predicate const& p: s.predicates) {
+            if (!p.path->steps.empty() || p.path->result != query_result::attribute) {
+                throw std::invalid_argument("stream queries support only predicates on attributes");
+            }
+            c.attributes.push_back(std::make_pair(p.path->attribute, p.equals));
+        }
+        return c;
+    }
+
+    // the state of one run. A state is the number of steps matched
+    class evaluation {
+    public:
+        explicit evaluation(stream_query const& q)
+            : q(q), inherited_count(q.steps.size() + 1, 0), base(0) {
+            // the frame above the top element, where absolute queries start
+            frames.push_back(frame());
+            if (q.absolute) {
+                add_inherited(0);
+                frames.back().direct.push_back(0);
+            }
+        }
+
+        void start(stream_event const& e) {
+            frame const& parent_frame = frames.back();
+            frame f;
+            f.namespaces_size = namespaces.size();
+            f.inherited_size = inherited.size();
+            for (auto const& a: e.attributes) {
+                if (a.first == "xmlns") {
+                    namespaces.push_back(std::make_pair(std::string(), a.second));
+                } else if (a.first.compare(0, 6, "xmlns:") == 0) {
+                    namespaces.push_back(std::make_pair(a.first.substr(6), a.second));
+                }
+            }
+            for (std::size_t s: parent_frame.direct) {
+                if (s < q.steps.size() && q.steps[s].axis == query_axis::child && matches(q.steps[s], e)) {
+                    enter(f, s + 1, e);
+                }
+            }
+            for (std::size_t s: inherited) {
+                if (matches(q.steps[s], e)) {
+                    enter(f, s + 1, e);
+                }
+            }
+            if (!q.absolute && frames.size() == 1) {
+                // relative queries start at the top element
+                enter(f, 0, e);
+            }
+            for (std::size_t s: f.direct) {
+                add_inherited(s);
+            }
+            frames.push_back(std::move(f));
+        }
+
+        void text(std::string const& t) {
+            frame& f = frames.back();
+            if (f.slot != none && !f.has_text) {
+                // only the first text is used, so the result is complete
+                slots[f.slot - base] = std::make_pair(true, t);
+                f.has_text = true;
+            }
+        }
+
+        void end() {
+            frame& f = frames.back();
+            if (f.slot != none) {
+                slots[f.slot - base].first = true;
+            }
+            for (std::size_t s: f.direct) {
+                if (s < q.steps.size() && q.steps[s].axis == query_axis::descendant) {
+                    --inherited_count[s];
+                }
+            }
+            inherited.resize(f.inherited_size);
+            namespaces.resize(f.namespaces_size);
+            frames.pop_back();
+        }
+
+        // gives the results that are complete, in order
+        template <typename Output>
+        void flush(Output& output) {
+            while (!slots.empty() && slots.front().first) {
+                output(slots.front().second);
+                slots.pop_front();
+                ++base;
+            }
+        }
+
+    private:
+        enum : std::size_t { none = std::size_t(-1) };
+
+        struct frame {
+            frame() : namespaces_size(0), inherited_size(0), slot(none), has_text(false) {}
+            // the states entered at the element
+            std::vector<std::size_t> direct;
+            std::size_t namespaces_size;
+            std::size_t inherited_size;
+            // the result waiting for the text of the element
+            std::size_t slot;
+            bool has_text;
+        };
+
+        void add_inherited(std::size_t s) {
+            if (s < q.steps.size() && q.steps[s].axis == query_axis::descendant &&
+                    inherited_count[s]++ == 0) {
+                inherited.push_back(s);
+            }
+        }
+
+        void enter(frame& f, std::size_t s, stream_event const& e) {
+            if (std::find(f.direct.begin(), f.direct.end(), s) != f.direct.end()) {
+                return;
+            }
+            f.direct.push_back(s);
+            if (s != q.steps.size()) {
+                return;
+            }
+            switch (q.result) {
+            case query_result::attribute:
+                for (auto const& a: e.attributes) {
+                    if (a.first == q.attribute) {
+                        slots.push_back(std::make_pair(true, a.second));
+                        break;
+                    }
+                }
+                break;
+            case query_result::name:
+                slots.push_back(std::make_pair(true, local(e.name)));
+                break;
+            case query_result::text:
+            case query_result::nodes:
+                f.slot = base + slots.size();
+                slots.push_back(std::make_pair(false, std::string()));
+                break;
+            }
+        }
+
+        static std::string local(std::string const& name) {
+            std::string::size_type colon = name.find(':');
+            return colon == std::string::npos ? name : name.substr(colon + 1);
+        }
+
+        bool matches(step const& s, stream_event const& e) const {
+            std::string::size_type colon = e.name.find(':');
+            std::size_t local_start = colon == std::string::npos ? 0 : colon + 1;
+            if (!s.any_name && e.name.compare(local_start, std::string::npos, s.name) != 0) {
+                return false;
+            }
+            if (s.has_uri) {
+                std::string prefix = colon == std::string::npos ? std::string() : e.name.substr(0, colon);
+                auto i = std::find_if(namespaces.rbegin(), namespaces.rend(),
+                                      [&prefix](std::pair<std::string, std::string> const& n) {
+                                          return n.first == prefix;
+                                      });
+                if (i == namespaces.rend() || i->second != s.uri) {
+                    return false;
+                }
+            }
+            for (auto const& required: s.attributes) {
+                auto a = std::find_if(e.attributes.begin(), e.attributes.end(),
+                                      [&required](std::pair<std::string, std::string> const& a) {
+                                          return a.first == required.first;
+                                      });
+                if (a == e.attributes.end() || (required.second && a->second != *required.second)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        stream_query const& q;
+        // the open elements, below the frame above the top element
+        std::vector<frame> frames;
+        // the states with a descendant step entered at an open element,
+        // once each, with the number of open elements that entered them
+        std::vector<std::size_t> inherited;
+        std::vector<unsigned> inherited_count;
+        // the namespace declarations of the open elements, prefix -> uri
+        std::vector<std::pair<std::string, std::string> > namespaces;
+        // the results not given yet, and if they are complete. The
+        // first one may be incomplete and hold the rest, see above
+        std::deque<std::pair<bool, std::string> > slots;
+        // the number of results given
+        std::size_t base;
+    };
+
+    bool absolute;
+    std::vector<step> steps;
+    query_result result;
+    std::string attribute;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_STREAM_QUERY_HPP
@@ -0,0 +1,407 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_STREAM_TOKENIZER_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_STREAM_TOKENIZER_HPP
+
+#include <cstddef>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// thrown when the input of a stream_tokenizer is not well formed XML.
+// offset is the number of characters read when the error was found
+class stream_syntax_error : public std::runtime_error {
+public:
+    stream_syntax_error(std::string const& message, std::size_t offset)
+        : std::runtime_error(message + " at offset " + std::to_string(offset)),
+          offset(offset) {
+    }
+
+    std::size_t offset;
+};
+
+// What a stream_tokenizer reads
+struct stream_event {
+    enum kind_type {
+        // a start tag, with name and attributes
+        start_tag,
+        // an end tag, also given after an empty element tag like '<a/>'
+        end_tag,
+        // character data in text, with the entities replaced, or a CDATA
+        // section. Only inside the top element, and like pugixml's
+        // default parsing, text of only whitespace is left out
+        characters
+    };
+
+    kind_type kind;
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > attributes;
+    std::string text;
+};
+
+// A pull tokenizer that reads XML from a stream in blocks, and keeps
+// only the names of the open elements besides the current block and
+// event. Comments, processing instructions and the document type
+// declaration are skipped, and the predefined and numeric entities are
+// replaced. The tags must be balanced. Other DTD features, like
+// entities declared in the document, are not supported.
+class stream_tokenizer {
+public:
+    explicit stream_tokenizer(std::istream& in, std::size_t block_size = 1 << 16)
+        : in(in), block(block_size), pos(0), size(0), consumed(0),
+          pending_end(false), seen_top(false) {
+    }
+
+    // reads the next event into e, the buffers of e are reused.
+    // Returns false at the end of the input
+    bool next(stream_event& e) {
+        if (pending_end) {
+            pending_end = false;
+            e.kind = stream_event::end_tag;
+            e.name = open.back();
+            open.pop_back();
+            return true;
+        }
+        for (;;) {
+            int c = peek();
+            if (c == eof) {
+                if (!open.empty()) {
+                    fail("unexpected end of input in '" + open.back() + "'");
+                }
+                return false;
+            }
+            if (c != '<') {
+                if (read_text(e.text) && !open.empty()) {
+                    e.kind = stream_event::characters;
+                    return true;
+                }
+                continue;
+            }
+            get();
+            c = peek();
+            if (c == '?') {
+                skip_past("?>");
+            } else if (c == '!') {
+                get();
+                if (take("--")) {
+                    skip_past("-->");
+                } else if (take("[CDATA[")) {
+                    read_cdata(e.text);
+                    if (open.empty()) {
+                        fail("CDATA outside the top element");
+                    }
+                    e.kind = stream_event::characters;
+                    return true;
+                } else {
+                    skip_declaration();
+                }
+            } else if (c == '/') {
+                get();
+                read_name(e.name);
+                skip_space();
+                expect('>');
+                if (open.empty() || open.back() != e.name) {
+                    fail("unexpected end tag '" + e.name + "'");
+                }
+                open.pop_back();
+                e.kind = stream_event::end_tag;
+                return true;
+            } else {
+                read_start_tag(e);
+                return true;
+            }
+        }
+    }
+
+    // the number of characters read
+    std::size_t offset() const {
+        return consumed + pos;
+    }
+
+    // the number of open elements
+    std::size_t depth() const {
+        return open.size();
+    }
+
+private:
+    enum { eof = -1 };
+
+    int peek() {
+        if (pos == size && !fill()) {
+            return eof;
+        }
+        return static_cast<unsigned char>(block[pos]);
+    }
+
+    int get() {
+        int c = peek();
+        if (c != eof) {
+            ++pos;
+        }
+        return c;
+    }
+
+    bool fill() {
+        consumed += size;
+        pos = 0;
+        in.read(&block[0], std::streamsize(block.size()));
+        size = std::size_t(in.gcount());
+        return size > 0;
+    }
+
+    void fail(std::string const& message) const {
+        throw stream_syntax_error(message, offset());
+    }
+
+    static bool is_space(int c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    void skip_space() {
+        while (is_space(peek())) {
+            get();
+        }
+    }
+
+    void expect(char c) {
+        if (get() != c) {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    // consumes s if the input continues with it. Only used right
+    // after '<!', where the alternatives differ in the first character
+    bool take(const char* s) {
+        if (peek() != static_cast<unsigned char>(*s)) {
+            return false;
+        }
+        for (; *s; ++s) {
+            if (get() != static_cast<unsigned char>(*s)) {
+                fail(std::string("expected '") + s + "'");
+            }
+        }
+        return true;
+    }
+
+    // skips to after the terminator, e.g. "-->"
+    void skip_past(std::string const& terminator) {
+        // the last characters read
+        std::string window;
+        while (window != terminator) {
+            int c = get();
+            if (c == eof) {
+                fail("unexpected end of input, expected '" + terminator + "'");
+            }
+            if (window.size() == terminator.size()) {
+                window.erase(0, 1);
+            }
+            window += char(c);
+        }
+    }
+
+    // skips '<!DOCTYPE ...>', including an internal subset in '[...]'
+    void skip_declaration() {
+        int brackets = 0;
+        for (;;) {
+            int c = get();
+            if (c == eof) {
+                fail("unexpected end of input in declaration");
+            } else if (c == '[') {
+                ++brackets;
+            } else if (c == ']') {
+                --brackets;
+            } else if (c == '>' && brackets <= 0) {
+                return;
+            }
+        }
+    }
+
+    void read_name(std::string& name) {
+        name.clear();
+        for (;;) {
+            int c = peek();
+            if (c == eof || is_space(c) || c == '/' || c == '>' || c == '=') {
+                break;
+            }
+            name += char(get());
+        }
+        if (name.empty()) {
+            fail("expected a name");
+        }
+    }
+
+    void read_start_tag(stream_event& e) {
+        read_name(e.name);
+        e.attributes.clear();
+        for (;;) {
+            skip_space();
+            int c = peek();
+            if (c == '/') {
+                get();
+                expect('>');
+                pending_end = true;
+                break;
+            }
+            if (c == '>') {
+                get();
+                break;
+            }
+            e.attributes.push_back(std::make_pair(std::string(), std::string()));
+            read_name(e.attributes.back().first);
+            skip_space();
+            expect('=');
+            skip_space();
+            int quote = get();
+            if (quote != '"' && quote != '\'') {
+                fail("expected a quoted attribute value");
+            }
+            std::string& value = e.attributes.back().second;
+            for (;;) {
+                c = get();
+                if (c == eof) {
+                    fail("unexpected end of input in attribute value");
+                } else if (c == quote) {
+                    break;
+                } else if (c == '&') {
+                    read_entity(value);
+                } else if (c == '<') {
+                    fail("'<' in attribute value");
+                } else {
+                    value += char(c);
+                }
+            }
+        }
+        if (open.empty() && seen_top) {
+            fail("more than one top element");
+        }
+        seen_top = true;
+        open.push_back(e.name);
+        e.kind = stream_event::start_tag;
+    }
+
+    // reads up to the next '<'. Returns false if the text is only
+    // whitespace
+    bool read_text(std::string& text) {
+        text.clear();
+        bool space = true;
+        for (;;) {
+            int c = peek();
+            if (c == eof || c == '<') {
+                break;
+            }
+            get();
+            if (c == '&') {
+                read_entity(text);
+                space = false;
+            } else {
+                text += char(c);
+                space = space && is_space(c);
+            }
+        }
+        if (!space && open.empty()) {
+            fail("text outside the top element");
+        }
+        return !space;
+    }
+
+    void read_cdata(std::string& text) {
+        text.clear();
+        for (;;) {
+            int c = get();
+            if (c == eof) {
+                fail("unexpected end of input in CDATA");
+            }
+            text += char(c);
+            std::size_t n = text.size();
+            if (n >= 3 && text.compare(n - 3, 3, "]]>") == 0) {
+                text.resize(n - 3);
+                return;
+            }
+        }
+    }
+
+    // reads the rest of an entity after '&' and appends its value
+    void read_entity(std::string& out) {
+        std::string name;
+        for (;;) {
+            int c = get();
+            if (c == ';') {
+                break;
+            }
+            if (c == eof || name.size() > 10) {
+                fail("unterminated entity");
+            }
+            name += char(c);
+        }
+        if (name == "lt") {
+            out += '<';
+        } else if (name == "gt") {
+            out += '>';
+        } else if (name == "amp") {
+            out += '&';
+        } else if (name == "quot") {
+            out += '"';
+        } else if (name == "apos") {
+            out += '\'';
+        } else if (name.size() > 1 && name[0] == '#') {
+            bool hex = name[1] == 'x';
+            unsigned long code = 0;
+            try {
+                std::size_t used = 0;
+                code = std::stoul(name.substr(hex ? 2 : 1), &used, hex ? 16 : 10);
+                if (used != name.size() - (hex ? 2 : 1)) {
+                    fail("bad character reference '&" + name + ";'");
+                }
+            } catch (std::logic_error const&) {
+                fail("bad character reference '&" + name + ";'");
+            }
+            append_utf8(out, code);
+        } else {
+            fail("unknown entity '&" + name + ";'");
+        }
+    }
+
+    void append_utf8(std::string& out, unsigned long code) {
+        if (code < 0x80) {
+            out += char(code);
+        } else if (code < 0x800) {
+            out += char(0xC0 | (code >> 6));
+            out += char(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += char(0xE0 | (code >> 12));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        } else if (code < 0x110000) {
+            out += char(0xF0 | (code >> 18));
+            out += char(0x80 | ((code >> 12) & 0x3F));
+            out += char(0x80 | ((code >> 6) & 0x3F));
+            out += char(0x80 | (code & 0x3F));
+        } else {
+            fail("character reference out of range");
+        }
+    }
+
+    std::istream& in;
+    std::vector<char> block;
+    std::size_t pos;
+    std::size_t size;
+    // the characters in the blocks before the current one
+    std::size_t consumed;
+    // set after an empty element tag, the end event comes next
+    bool pending_end;
+    bool seen_top;
+    // the names of the open elements
+    std::vector<std::string> open;
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_STREAM_TOKENIZER_HPP
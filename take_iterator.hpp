@@ -0,0 +1,74 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TAKE_ITERATOR
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TAKE_ITERATOR
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <cstddef>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// An iterator over at most n entries of another range. It reaches
+// the end after the n-th entry without incrementing the underlying
+// iterator again, so the search for an entry that is not wanted is
+// never started.
+template <typename BaseIterator>
+class take_iterator : public boost::iterator_facade<
+        take_iterator<BaseIterator>,
+        typename BaseIterator::value_type,
+        boost::forward_traversal_tag,
+        typename BaseIterator::reference> {
+public:
+    take_iterator() : remaining(0) {}
+
+    // the end iterator
+    explicit take_iterator(BaseIterator const& end)
+        : it(end), end(end), remaining(0) {}
+
+    take_iterator(BaseIterator begin, BaseIterator end, std::size_t n)
+        : it(std::move(begin)), end(std::move(end)), remaining(n) {}
+
+    void increment() {
+        if (--remaining > 0) {
+            ++it;
+        }
+    }
+
+    bool equal(take_iterator const& other) const {
+        bool at_end = is_end();
+        if (at_end || other.is_end()) {
+            return at_end == other.is_end();
+        }
+        return it == other.it;
+    }
+
+    typename BaseIterator::reference dereference() const {
+        return *it;
+    }
+
+private:
+    bool is_end() const {
+        return remaining == 0 || it == end;
+    }
+
+    BaseIterator it;
+    BaseIterator end;
+    std::size_t remaining;
+};
+
+template <typename Range>
+boost::iterator_range<take_iterator<typename Range::iterator> >
+make_take(Range const& r, std::size_t n) {
+    return boost::make_iterator_range
+            (take_iterator<typename Range::iterator>(r.begin(), r.end(), n),
+             take_iterator<typename Range::iterator>(r.end()));
+}
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TAKE_ITERATOR
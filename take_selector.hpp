@@ -0,0 +1,50 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TAKE_SELECTOR_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TAKE_SELECTOR_HPP
+
+#include "selector_common.hpp"
+#include "take_iterator.hpp"
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// Type for the take selector, holds the number of entries to take
+struct _take {
+    explicit _take(std::size_t n) : n(n) {}
+    std::size_t n;
+};
+
+/// Selects the first n entries of the range, e.g.
+/// 'range | descendant("foo") | take(20)'. The traversal of the
+/// input stops once the n-th entry is found, also when the result
+/// is used through range<T>.
+inline _take take(std::size_t n) {
+    return _take(n);
+}
+
+// Implements the pipe operator for the take selector. E.g.
+// 'range | take(20)'
+template <typename Range>
+boost::iterator_range<take_iterator<typename Range::iterator> >
+operator|(Range const& range, _take t)
+{
+    return make_take(range, t.n);
+}
+
+// enables the take selector in sub-expressions
+template <>
+struct is_expr<_take>: std::true_type {
+};
+
+// take counts the entries of the whole range
+template <>
+struct is_range_selector<_take>: std::true_type {
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TAKE_SELECTOR_HPP
@@ -0,0 +1,352 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../pugi_adaptor.hpp"
+#include "../query_cache.hpp"
+#include "../query_set.hpp"
+
+#include <pugixml.hpp>
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mediasequencer::plugin::util::xpath;
+
+namespace {
+
+typedef compiled_query<_context<PugiXmlAdaptor> > query;
+
+const char* const document_xml =
+        "<a xmlns:p=\"urn:p\">"
+            "<b c=\"d\">"
+                "<x><e>one</e></x>"
+                "<e>two</e>"
+            "</b>"
+            "<b c=\"z\">"
+                "<e>three</e>"
+            "</b>"
+            "<p:b c=\"d\">"
+                "<e>four</e>"
+            "</p:b>"
+            "<f><b c=\"d\"><e>five</e></b></f>"
+        "</a>";
+
+struct document_fixture {
+    pugi::xml_document document;
+
+    document_fixture() {
+        std::istringstream iss(document_xml);
+        auto status = document.load(iss);
+        BOOST_REQUIRE_MESSAGE(status, "Parsing error: " << status.description());
+    }
+
+    pugi::xml_node root() {
+        return document.root().first_child();
+    }
+};
+
+template <typename Range>
+std::vector<std::string> to_vector(Range const& r) {
+    std::vector<std::string> v;
+    for (auto i = r.begin(); i != r.end(); ++i) {
+        v.push_back(std::string(*i));
+    }
+    return v;
+}
+
+void check_strings(std::vector<std::string> const& expected, query::string_range const& actual) {
+    std::vector<std::string> v = to_vector(actual);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), v.begin(), v.end());
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(parse_query_steps)
+{
+    query_path p = parse_query("a/b[@c='d']//e/text()");
+    BOOST_CHECK(!p.absolute);
+    BOOST_REQUIRE_EQUAL(3u, p.steps.size());
+    BOOST_CHECK(p.steps[0].axis == query_axis::child);
+    BOOST_CHECK_EQUAL("a", p.steps[0].name);
+    BOOST_CHECK_EQUAL("b", p.steps[1].name);
+    BOOST_REQUIRE_EQUAL(1u, p.steps[1].predicates.size());
+    BOOST_CHECK(p.steps[1].predicates[0].path->result == query_result::attribute);
+    BOOST_CHECK_EQUAL("c", p.steps[1].predicates[0].path->attribute);
+    BOOST_CHECK_EQUAL("d", *p.steps[1].predicates[0].equals);
+    BOOST_CHECK(p.steps[2].axis == query_axis::descendant);
+    BOOST_CHECK_EQUAL("e", p.steps[2].name);
+    BOOST_CHECK(p.result == query_result::text);
+
+    query_path q = parse_query("/p:b/ancestor::*/..");
+    BOOST_CHECK(q.absolute);
+    BOOST_REQUIRE_EQUAL(3u, q.steps.size());
+    BOOST_CHECK_EQUAL("p", q.steps[0].prefix);
+    BOOST_CHECK(q.steps[1].axis == query_axis::ancestor);
+    BOOST_CHECK(q.steps[1].name.empty());
+    BOOST_CHECK(q.steps[2].axis == query_axis::parent);
+}
+
+BOOST_AUTO_TEST_CASE(parse_query_errors)
+{
+    BOOST_CHECK_THROW(parse_query("a/"), query_syntax_error);
+    BOOST_CHECK_THROW(parse_query("a[@b"), query_syntax_error);
+    BOOST_CHECK_THROW(parse_query("a[@b='c]"), query_syntax_error);
+    BOOST_CHECK_THROW(parse_query("a/@b/c"), query_syntax_error);
+    BOOST_CHECK_THROW(parse_query("following::a"), query_syntax_error);
+    BOOST_CHECK_THROW(parse_query("a//@b"), query_syntax_error);
+    try {
+        parse_query("a/b]");
+        BOOST_ERROR("expected query_syntax_error");
+    } catch (query_syntax_error const& e) {
+        BOOST_CHECK_EQUAL(3u, e.position);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_query_text)
+{
+    document_fixture f;
+    query q("b[@c='d']//e/text()");
+
+    check_strings({"one", "two", "four"}, q.strings(context(f.root())));
+    // evaluated again without parsing
+    check_strings({"one", "two", "four"}, q.strings(context(f.root())));
+    check_strings({"five"}, q.strings(context(f.root()) | child("f")));
+}
+
+BOOST_AUTO_TEST_CASE(compiled_query_nodes_match_selectors)
+{
+    document_fixture f;
+    auto c = context(f.root());
+
+    query q("b/e");
+    auto expected = c | child("b") | child("e") | text;
+    check_strings(to_vector(expected), q.strings(c));
+    BOOST_CHECK_EQUAL(3, boost::distance(c | q));
+    BOOST_CHECK_EQUAL(1, boost::distance(c | child | where(query("e[.='two']"))));
+    BOOST_CHECK_EQUAL(3, boost::distance(c | child | where(query("@c"))));
+}
+
+BOOST_AUTO_TEST_CASE(compiled_query_axes_and_terminals)
+{
+    document_fixture f;
+    auto c = context(f.root());
+
+    check_strings({"d", "z", "d"}, query("b/@c").strings(c));
+    check_strings({"b", "b", "b", "f"}, query("*/name()").strings(c));
+    check_strings({"x", "b", "a"}, query("//e[.='one']/ancestor::*/name()").strings(c));
+    check_strings({"b"}, query("//e[.='one']/ancestor::*[@c='d']/name()").strings(c));
+    check_strings({"one"}, query("b/x/e/../e/self::e").strings(c));
+}
+
+BOOST_AUTO_TEST_CASE(compiled_query_absolute_and_namespaces)
+{
+    document_fixture f;
+    pugi::xml_node e = f.root().child("b").child("x").child("e");
+
+    check_strings({"one", "two", "three", "four", "five"}, query("//e").strings(context(e)));
+    check_strings({"d", "z", "d"}, query("/a/b/@c").strings(context(e)));
+    check_strings({}, query("/b").strings(context(e)));
+
+    check_strings({"four"}, query("q:b/e", {{"q", "urn:p"}}).strings(context(f.root())));
+    BOOST_CHECK_THROW(query("q:b"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(query_cache_counts_and_evicts)
+{
+    document_fixture f;
+    query_cache<_context<PugiXmlAdaptor> > cache(2);
+
+    check_strings({"d", "z", "d"}, cache.get("b/@c").strings(context(f.root())));
+    cache.get("b/@c");
+    cache.get("f");
+    // the same string with other bindings is another query
+    check_strings({"four"}, cache.get("q:b/e", {{"q", "urn:p"}}).strings(context(f.root())));
+
+    query_cache_statistics s = cache.statistics();
+    BOOST_CHECK_EQUAL(1u, s.hits);
+    BOOST_CHECK_EQUAL(3u, s.misses);
+    BOOST_CHECK_EQUAL(1u, s.evictions);
+    BOOST_CHECK_EQUAL(2u, cache.size());
+
+    // "b/@c" was least recently used and is compiled again
+    cache.get("f");
+    cache.get("b/@c");
+    s = cache.statistics();
+    BOOST_CHECK_EQUAL(2u, s.hits);
+    BOOST_CHECK_EQUAL(4u, s.misses);
+    BOOST_CHECK_EQUAL(2u, s.evictions);
+
+    BOOST_CHECK_THROW(cache.get("b/"), query_syntax_error);
+    BOOST_CHECK_EQUAL(2u, cache.size());
+
+    // bindings that contain the characters a key could be joined with
+    // are still other queries
+    query_cache<_context<PugiXmlAdaptor> > keys(8);
+    keys.get("q:b/e", {{"q", std::string("urn:p\0r\0urn:r", 13)}});
+    keys.get("q:b/e", {{"q", "urn:p"}, {"r", "urn:r"}});
+    keys.get("q:b/e", {{"q", "urn:p"}, {"r", std::string("urn:r")}});
+    s = keys.statistics();
+    BOOST_CHECK_EQUAL(1u, s.hits);
+    BOOST_CHECK_EQUAL(2u, s.misses);
+    BOOST_CHECK_EQUAL(2u, keys.size());
+}
+
+BOOST_AUTO_TEST_CASE(query_cache_shared_between_threads)
+{
+    document_fixture f;
+    query_cache<_context<PugiXmlAdaptor> > cache(8);
+    const std::vector<std::string> queries = {"b", "b/e", "//e", "*/name()", "b/@c"};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([&cache, &queries] {
+            for (int i = 0; i < 200; ++i) {
+                cache.get(queries[i % queries.size()]);
+            }
+        }));
+    }
+    for (std::thread& t: threads) {
+        t.join();
+    }
+
+    query_cache_statistics s = cache.statistics();
+    BOOST_CHECK_EQUAL(800u, s.hits + s.misses);
+    BOOST_CHECK_EQUAL(0u, s.evictions);
+    BOOST_CHECK_EQUAL(queries.size(), cache.size());
+    check_strings({"one", "two", "three", "four", "five"}, cache.get("//e").strings(context(f.root())));
+}
+
+BOOST_AUTO_TEST_CASE(query_set_matches_compiled_queries)
+{
+    document_fixture f;
+    auto c = context(f.root());
+    const std::vector<std::string> queries = {
+        "b/e/text()", "b[@c='d']//e/text()", "//e", "b/@c", "*/name()", "f//e",
+        "b/x/e/../e/self::e", "//e[.='one']/ancestor::*/name()", "/a/b/@c",
+        "q:b/e", ".", "//x/e", "//nothing/e"
+    };
+    const namespace_bindings bindings = {{"q", "urn:p"}};
+
+    query_set<_context<PugiXmlAdaptor> > set;
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        BOOST_CHECK_EQUAL(i, set.add(queries[i], bindings));
+    }
+    BOOST_CHECK_EQUAL(queries.size(), set.size());
+
+    std::vector<std::vector<std::string> > strings = set.strings(c);
+    std::vector<std::vector<_context<PugiXmlAdaptor> > > nodes = set.nodes(c);
+    BOOST_REQUIRE_EQUAL(queries.size(), strings.size());
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        BOOST_TEST_MESSAGE(queries[i]);
+        query q(queries[i], bindings);
+        check_strings(strings[i], q.strings(c));
+        BOOST_CHECK_EQUAL(boost::distance(q.nodes(c)), nodes[i].size());
+    }
+
+    // absolute queries from below the top element
+    auto e = context(f.root().child("b").child("x").child("e"));
+    strings = set.strings(e);
+    check_strings(strings[2], query("//e").strings(e));
+    check_strings(strings[8], query("/a/b/@c").strings(e));
+    BOOST_CHECK(strings[0].empty());
+}
+
+BOOST_AUTO_TEST_CASE(query_set_shares_states)
+{
+    document_fixture f;
+    query_set<_context<PugiXmlAdaptor> > set;
+    set.add("b/e");
+    set.add("b/e/text()");
+    set.add("b//e");
+    // the two start states, b, b/e and b//e
+    BOOST_CHECK_EQUAL(5u, set.state_count());
+    // steps with predicates are not shared
+    set.add("b[@c]/e");
+    BOOST_CHECK_EQUAL(7u, set.state_count());
+
+    BOOST_CHECK_THROW(set.add("q:b"), std::invalid_argument);
+    BOOST_CHECK_THROW(set.add("b/"), query_syntax_error);
+    BOOST_CHECK_EQUAL(7u, set.state_count());
+    BOOST_CHECK_EQUAL(4u, set.size());
+}
+
+BOOST_AUTO_TEST_CASE(query_set_gives_order_of_compiled_queries)
+{
+    std::istringstream iss("<r><a><b>1</b><a><b>2</b></a><b>3</b></a></r>");
+    pugi::xml_document document;
+    BOOST_REQUIRE(document.load(iss));
+    auto c = context(document.root().first_child());
+
+    query_set<_context<PugiXmlAdaptor> > set;
+    set.add("//a/b/text()");
+    set.add("//a//b/text()");
+    std::vector<std::vector<std::string> > strings = set.strings(c);
+    // the b's of the outer a come before those of the inner one
+    std::vector<std::string> expected = {"1", "3", "2"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), strings[0].begin(), strings[0].end());
+    // b 2 is below both a's, and is given for each of them
+    std::vector<std::string> nested = {"1", "2", "3", "2"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(nested.begin(), nested.end(), strings[1].begin(), strings[1].end());
+
+    // child steps after the descendant step, with the inner a first
+    std::istringstream inner("<r><a><a><b id='1'/></a><b id='2'/></a></r>");
+    BOOST_REQUIRE(document.load(inner));
+    c = context(document.root().first_child());
+    const std::vector<std::string> queries = {"//a/b/@id", "descendant::a/b/@id"};
+    query_set<_context<PugiXmlAdaptor> > ids;
+    for (std::string const& q: queries) {
+        ids.add(q);
+    }
+    strings = ids.strings(c);
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+        check_strings(strings[i], query(queries[i]).strings(c));
+    }
+    std::vector<std::string> outer_first = {"2", "1"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(outer_first.begin(), outer_first.end(), strings[0].begin(), strings[0].end());
+}
+
+BOOST_AUTO_TEST_CASE(query_set_keeps_duplicates_of_compiled_queries)
+{
+    std::istringstream iss("<r><p><x/><x/></p><a><a><b>1</b></a><b>2</b></a>"
+                           "<a><c><a><b>3</b><d><b>4</b></d></a></c></a></r>");
+    pugi::xml_document document;
+    BOOST_REQUIRE(document.load(iss));
+    typedef _context<PugiXmlAdaptor> Context;
+    const std::vector<std::string> queries = {
+        "//a//b/text()", "//a//b", "//x/..", "//x/../name()", "a//b/..", "//a/a//b/text()",
+        "//a//d//b", "a//a//b/text()", "//b/ancestor::a/name()", "/r//a//b/text()"
+    };
+    query_set<Context> set;
+    for (std::string const& q: queries) {
+        set.add(q);
+    }
+
+    for (pugi::xml_node n: {document.root().first_child(), document.root().first_child().child("a")}) {
+        auto c = context(n);
+        std::vector<std::vector<std::string> > strings = set.strings(c);
+        std::vector<std::vector<Context> > nodes = set.nodes(c);
+        for (std::size_t i = 0; i < queries.size(); ++i) {
+            BOOST_TEST_MESSAGE(queries[i]);
+            query q(queries[i]);
+            std::vector<std::string> expected = to_vector(q.strings(c));
+            BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                          strings[i].begin(), strings[i].end());
+            auto expected_nodes = q.nodes(c);
+            BOOST_REQUIRE_EQUAL(boost::distance(expected_nodes), nodes[i].size());
+            auto k = nodes[i].begin();
+            for (auto j = expected_nodes.begin(); j != expected_nodes.end(); ++j, ++k) {
+                BOOST_CHECK((*j).get_node() == k->get_node());
+            }
+        }
+    }
+    // b 1, 3 and 4 are each below two a's
+    auto r = context(document.root().first_child());
+    BOOST_CHECK_EQUAL(7u, set.strings(r)[0].size());
+    BOOST_CHECK_EQUAL(2u, set.nodes(r)[2].size());
+}
@@ -0,0 +1,241 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../pugi_adaptor.hpp"
+#include "../indexed_document.hpp"
+#include "../name_index.hpp"
+#include "../attribute_index.hpp"
+#include "../node_set.hpp"
+
+#include <pugixml.hpp>
+
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mediasequencer::plugin::util::xpath;
+
+namespace {
+
+struct indexed_fixture {
+    pugi::xml_document document;
+
+    explicit indexed_fixture(const char* xml) {
+        std::istringstream iss(xml);
+        auto status = document.load(iss);
+        BOOST_REQUIRE_MESSAGE(status, "Parsing error: " << status.description());
+    }
+
+    pugi::xml_node root() {
+        return document.root().first_child();
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(indexed_document_numbers)
+{
+    indexed_fixture f("<a><b><c/><d/></b><e><f/></e></a>");
+    indexed_document index(f.root());
+
+    BOOST_REQUIRE_EQUAL(6u, index.size());
+    const char* names[] = {"a", "b", "c", "d", "e", "f"};
+    unsigned posts[] = {5, 2, 0, 1, 4, 3};
+    unsigned depths[] = {0, 1, 2, 2, 1, 2};
+    unsigned ends[] = {6, 4, 3, 4, 6, 6};
+    for (indexed_document::id_type i = 0; i < index.size(); ++i) {
+        BOOST_CHECK_EQUAL(names[i], index.node(i).name());
+        BOOST_CHECK_EQUAL(i, index.id(index.node(i)));
+        BOOST_CHECK_EQUAL(i, index.pre(i));
+        BOOST_CHECK_EQUAL(posts[i], index.post(i));
+        BOOST_CHECK_EQUAL(depths[i], index.depth(i));
+        BOOST_CHECK_EQUAL(ends[i], index.subtree_end(i));
+    }
+    BOOST_CHECK_EQUAL(indexed_document::npos, index.parent(0));
+    BOOST_CHECK_EQUAL(4u, index.parent(5));
+    BOOST_CHECK_EQUAL(indexed_document::npos, index.id(pugi::xml_node()));
+}
+
+BOOST_AUTO_TEST_CASE(indexed_document_structure)
+{
+    indexed_fixture f("<a><b><c/><d/></b><e><f/></e></a>");
+    indexed_document index(f.root());
+    pugi::xml_node a = f.root(), b = a.child("b"), e = a.child("e");
+    auto id = [&index](pugi::xml_node const& n) {
+        return index.id(n);
+    };
+
+    BOOST_CHECK(index.is_ancestor(id(a), id(b.child("d"))));
+    BOOST_CHECK(index.is_ancestor(id(b), id(b.child("d"))));
+    BOOST_CHECK(!index.is_ancestor(id(b), id(e.child("f"))));
+    BOOST_CHECK(!index.is_ancestor(id(b), id(b)));
+    BOOST_CHECK(index.is_inside(id(b), id(b)));
+    BOOST_CHECK(index.is_inside(id(e.child("f")), id(e)));
+    BOOST_CHECK(!index.is_inside(id(e), id(b)));
+    BOOST_CHECK(index.precedes(id(b.child("d")), id(e)));
+}
+
+BOOST_AUTO_TEST_CASE(indexed_document_order_of_results)
+{
+    indexed_fixture f("<a><b><c/><d/></b><e><c/></e><c/></a>");
+    indexed_document index(f.root());
+
+    auto parents = context(f.root()) | descendant("c") | parent;
+    std::vector<_context<PugiXmlAdaptor> > v(parents.begin(), parents.end());
+    std::reverse(v.begin(), v.end());
+    std::sort(v.begin(), v.end(), document_order(index));
+
+    std::vector<std::string> names;
+    for (auto const& c: v) {
+        names.push_back(c.name());
+    }
+    std::vector<std::string> expected = {"a", "b", "e"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), names.begin(), names.end());
+}
+
+BOOST_AUTO_TEST_CASE(node_set_operations)
+{
+    indexed_fixture f("<a><b><c/><d/></b><e><c/></e><c/></a>");
+    indexed_document index(f.root());
+    auto c = context(f.root());
+
+    // parent gives b, e, a: sorted into document order
+    node_set parents(index, c | descendant("c") | parent);
+    std::vector<indexed_document::id_type> expected = {0, 1, 4};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), parents.begin(), parents.end());
+
+    node_set cs = c | descendant("c") | as_node_set(index);
+    node_set children = c | child | as_node_set(index);
+    expected = {2, 5, 6};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), cs.begin(), cs.end());
+    BOOST_CHECK(cs.contains(5));
+    BOOST_CHECK(!cs.contains(4));
+
+    // 'a || b' joins the ranges, unite gives each node once in order
+    BOOST_CHECK_EQUAL(6u, c | (child || descendant("c")) | count);
+    node_set both = unite(children, cs);
+    expected = {1, 2, 4, 5, 6};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), both.begin(), both.end());
+    BOOST_CHECK(both == unite(cs, children));
+
+    node_set common = intersect(children, cs);
+    expected = {6};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), common.begin(), common.end());
+
+    node_set nested = except(cs, children);
+    expected = {2, 5};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), nested.begin(), nested.end());
+    BOOST_CHECK(except(cs, cs).empty());
+
+    std::vector<std::string> names;
+    for (auto const& n: both.contexts<_context<PugiXmlAdaptor> >()) {
+        names.push_back(n.name());
+    }
+    std::vector<std::string> expected_names = {"b", "c", "e", "c", "c"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_names.begin(), expected_names.end(),
+                                  names.begin(), names.end());
+
+    BOOST_CHECK(node_set::from_ids(index, {6, 2, 6, 5}) == cs);
+
+    indexed_document other(f.root());
+    BOOST_CHECK_THROW(unite(cs, node_set(other)), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(indexed_descendant_matches_descendant)
+{
+    indexed_fixture f(
+            "<a xmlns:p=\"urn:p\">"
+                "<x id=\"1\"><b><x id=\"2\"/></b></x>"
+                "<p:x id=\"3\"><x id=\"4\"/></p:x>"
+                "<c><d/></c>"
+                "<x id=\"5\"/>"
+            "</a>");
+    indexed_document document(f.root());
+    name_index names(document);
+    auto c = context(f.root());
+
+    BOOST_CHECK_EQUAL(5u, names.nodes("x").size());
+    BOOST_CHECK(names.nodes("y").empty());
+
+    // overlapping inputs give duplicates, like descendant does
+    auto expected = c | descendant("x") | descendant("x") | attribute("id");
+    auto actual = c | descendant("x") | indexed_descendant(names, "x") | attribute("id");
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    auto expected_all = c | descendant("x") | attribute("id");
+    auto actual_all = c | indexed_descendant(names, "x") | attribute("id");
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_all.begin(), expected_all.end(),
+                                  actual_all.begin(), actual_all.end());
+
+    BOOST_CHECK_EQUAL(0u, c | child("c") | indexed_descendant(names, "x") | count);
+    BOOST_CHECK_EQUAL(1u, c | child("c") | indexed_descendant(names, "d") | count);
+    BOOST_CHECK_EQUAL(2u, c | child | where(indexed_descendant(names, "x")) | count);
+
+    // the contexts have the namespaces in scope of their node
+    auto ns_expected = c | descendant("x") | ns;
+    auto ns_actual = c | indexed_descendant(names, "x") | ns;
+    BOOST_CHECK_EQUAL_COLLECTIONS(ns_expected.begin(), ns_expected.end(),
+                                  ns_actual.begin(), ns_actual.end());
+
+    // each context is moved on from the one before, across branches
+    // that declare namespaces of their own
+    indexed_fixture deep(
+            "<r xmlns=\"urn:r\">"
+                "<a xmlns=\"urn:a\"><b><x/><c xmlns=\"urn:c\"><x/></c></b><x/></a>"
+                "<d><e xmlns=\"urn:e\"><f><x/></f></e><x/></d>"
+                "<x><x xmlns=\"urn:x\"/></x>"
+            "</r>");
+    indexed_document deep_document(deep.root());
+    name_index deep_names(deep_document);
+    auto r = context(deep.root());
+    auto deep_expected = r | descendant("x") | ns;
+    auto deep_actual = r | indexed_descendant(deep_names, "x") | ns;
+    BOOST_CHECK_EQUAL_COLLECTIONS(deep_expected.begin(), deep_expected.end(),
+                                  deep_actual.begin(), deep_actual.end());
+    auto from_children_expected = r | child | descendant("x") | parent | ns;
+    auto from_children_actual = r | child | indexed_descendant(deep_names, "x") | parent | ns;
+    BOOST_CHECK_EQUAL_COLLECTIONS(from_children_expected.begin(), from_children_expected.end(),
+                                  from_children_actual.begin(), from_children_actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(attribute_index_lookups)
+{
+    indexed_fixture f(
+            "<a>"
+                "<x id=\"1\" ref=\"2\"><y id=\"2\"/></x>"
+                "<x id=\"2\"><y ref=\"1\" key=\"k\"/></x>"
+                "<z id=\"3\"/>"
+            "</a>");
+    indexed_document document(f.root());
+    attribute_index attributes(document, {"id", "ref"});
+    auto c = context(f.root());
+
+    BOOST_CHECK(attributes.is_indexed("id"));
+    BOOST_CHECK(!attributes.is_indexed("key"));
+    BOOST_CHECK_EQUAL(2u, attributes.nodes("id", "2").size());
+    BOOST_CHECK(attributes.nodes("id", "4").empty());
+    BOOST_CHECK_THROW(attributes.nodes("key", "k"), std::invalid_argument);
+    // attribute("ref", "") matches the nodes without a ref too, which
+    // the index does not have
+    BOOST_CHECK_EQUAL(3u, c | descendant | attribute("ref", "") | count);
+    BOOST_CHECK_THROW(attributes.nodes("ref", ""), std::invalid_argument);
+    BOOST_CHECK_THROW(indexed_descendant(attributes, "ref", ""), std::invalid_argument);
+    BOOST_CHECK_THROW(indexed_attribute(attributes, "ref", ""), std::invalid_argument);
+
+    auto expected = c | descendant | attribute("id", "2") | name;
+    auto actual = c | indexed_descendant(attributes, "id", "2") | name;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    auto in_first = c | child("x") | indexed_descendant(attributes, "id", "2") | name;
+    std::vector<std::string> expected_in_first = {"y"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_in_first.begin(), expected_in_first.end(),
+                                  in_first.begin(), in_first.end());
+
+    BOOST_CHECK_EQUAL(1u, c | child | indexed_attribute(attributes, "ref", "2") | count);
+    BOOST_CHECK_EQUAL(1u, c | child | where(indexed_descendant(attributes, "ref", "1")) | count);
+}
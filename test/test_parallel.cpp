@@ -0,0 +1,215 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../pugi_adaptor.hpp"
+#include "../parallel.hpp"
+
+#include <pugixml.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mediasequencer::plugin::util::xpath;
+
+namespace {
+
+// a document with subtrees of very different sizes, so that the
+// workers have to split runs to share the work
+std::string make_document() {
+    std::ostringstream xml;
+    xml << "<a xmlns:p=\"urn:p\">";
+    for (int i = 0; i < 40; ++i) {
+        xml << "<b id=\"b" << i << "\" xmlns=\"urn:" << i % 3 << "\">";
+        for (int j = 0; j < (i % 7 == 0 ? 60 : 3); ++j) {
+            xml << "<x id=\"x" << i << "_" << j << "\">";
+            if (j % 2 == 0) {
+                xml << "<y>" << i << "." << j << "</y>";
+            }
+            xml << "<p:x><x id=\"n" << i << "_" << j << "\"/></p:x>";
+            xml << "</x>";
+        }
+        xml << "</b>";
+    }
+    xml << "</a>";
+    return xml.str();
+}
+
+struct parallel_fixture {
+    pugi::xml_document document;
+
+    parallel_fixture() {
+        std::istringstream iss(make_document());
+        auto status = document.load(iss);
+        BOOST_REQUIRE_MESSAGE(status, "Parsing error: " << status.description());
+    }
+
+    pugi::xml_node root() {
+        return document.root().first_child();
+    }
+};
+
+// a policy that uses the helpers from the start, as the document is
+// too small for them to be used otherwise
+parallel_policy eager(unsigned threads) {
+    return par(threads).alone(0, 0);
+}
+
+template <typename Range>
+std::vector<std::string> texts(Range const& r) {
+    std::vector<std::string> v;
+    for (auto i = r.begin(); i != r.end(); ++i) {
+        v.push_back((*i).to_text());
+    }
+    return v;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(parallel_descendant_matches_sequential)
+{
+    parallel_fixture f;
+    auto c = context(f.root());
+
+    for (unsigned threads: {1u, 2u, 4u, 8u}) {
+        std::vector<std::string> expected = texts(c | descendant("x"));
+        std::vector<std::string> actual = texts(evaluate(eager(threads), c, descendant("x")));
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+        auto where_range = c | descendant("x") | where(child("y")) | attribute("id");
+        std::vector<std::string> where_expected(where_range.begin(), where_range.end());
+        std::vector<std::string> where_actual =
+                evaluate(eager(threads), c, descendant("x") | where(child("y")) | attribute("id"));
+        BOOST_CHECK_EQUAL_COLLECTIONS(where_expected.begin(), where_expected.end(),
+                                      where_actual.begin(), where_actual.end());
+
+        auto text_range = c | descendant | child("y") | text;
+        std::vector<std::string> text_expected(text_range.begin(), text_range.end());
+        std::vector<std::string> text_actual = evaluate(eager(threads), c, descendant | child("y") | text);
+        BOOST_CHECK_EQUAL_COLLECTIONS(text_expected.begin(), text_expected.end(),
+                                      text_actual.begin(), text_actual.end());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_descendant_of_several_inputs)
+{
+    parallel_fixture f;
+    // overlapping inputs give duplicates, as in the sequential evaluation
+    auto inputs = context(f.root()) | descendant("b") | where(attribute("id"));
+    auto range = inputs | descendant("x") | attribute("id");
+    std::vector<std::string> expected(range.begin(), range.end());
+    std::vector<std::string> actual = evaluate(eager(4), inputs, descendant("x") | attribute("id"));
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+    auto leaves = context(f.root()) | descendant("y") | child;
+    BOOST_CHECK(evaluate(eager(4), leaves, descendant).empty());
+    BOOST_CHECK(evaluate(eager(4), context(f.root()), descendant("z")).empty());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_descendant_namespaces)
+{
+    parallel_fixture f;
+    auto c = singleton(context<flat_namespaces>(f.root()));
+    auto range = c | descendant | ns;
+    std::vector<std::string> expected(range.begin(), range.end());
+    std::vector<std::string> actual = evaluate(eager(4), c, descendant | ns);
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_where_keeps_input_order)
+{
+    parallel_fixture f;
+    auto inputs = context(f.root()) | descendant("x");
+    auto expected_range = inputs | where(descendant("y") | text_contains("2")) | attribute("id");
+    std::vector<std::string> expected(expected_range.begin(), expected_range.end());
+    BOOST_REQUIRE(!expected.empty());
+
+    for (unsigned threads: {1u, 3u, 8u}) {
+        std::vector<std::string> actual =
+                evaluate(eager(threads), inputs, where(descendant("y") | text_contains("2")) | attribute("id"));
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+
+        std::vector<std::string> nodes = texts(evaluate(eager(threads), inputs, where_not(child("y"))));
+        std::vector<std::string> expected_nodes = texts(inputs | where_not(child("y")));
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected_nodes.begin(), expected_nodes.end(), nodes.begin(), nodes.end());
+    }
+
+    BOOST_CHECK(evaluate(eager(4), inputs | where(child("z")), where(child("y"))).empty());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_where_range_selectors_see_all_results)
+{
+    parallel_fixture f;
+    auto inputs = context(f.root()) | descendant("x");
+
+    for (unsigned threads: {1u, 2u, 4u, 8u}) {
+        for (parallel_policy policy: {par(threads), eager(threads)}) {
+            std::vector<std::string> taken = texts(evaluate(policy, inputs, where(child("y")) | take(2)));
+            std::vector<std::string> expected_taken = texts(inputs | where(child("y")) | take(2));
+            BOOST_CHECK_EQUAL(taken.size(), 2u);
+            BOOST_CHECK_EQUAL_COLLECTIONS(expected_taken.begin(), expected_taken.end(),
+                                          taken.begin(), taken.end());
+
+            // the x elements in one b share the parent
+            std::vector<std::string> parents =
+                    texts(evaluate(policy, inputs, where(child("y")) | distinct_parent));
+            std::vector<std::string> expected_parents = texts(inputs | where(child("y")) | distinct_parent);
+            BOOST_CHECK_EQUAL_COLLECTIONS(expected_parents.begin(), expected_parents.end(),
+                                          parents.begin(), parents.end());
+        }
+    }
+
+    // many inputs, so that the helpers are asked for with the default
+    // policy
+    auto many = context(f.root()) | descendant;
+    auto expected_range = many | where(attribute("id")) | attribute("id");
+    std::vector<std::string> expected(expected_range.begin(), expected_range.end());
+    std::vector<std::string> actual = evaluate(par(4), many, where(attribute("id")) | attribute("id"));
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+}
+
+BOOST_AUTO_TEST_CASE(parallel_range_selectors_see_all_results)
+{
+    parallel_fixture f;
+    auto c = context(f.root());
+
+    for (unsigned threads: {1u, 2u, 4u, 8u}) {
+        for (parallel_policy policy: {par(threads), eager(threads)}) {
+            std::vector<std::string> first = texts(evaluate(policy, c, descendant("x") | take(1)));
+            std::vector<std::string> expected_first = texts(c | descendant("x") | take(1));
+            BOOST_CHECK_EQUAL(first.size(), 1u);
+            BOOST_CHECK_EQUAL_COLLECTIONS(expected_first.begin(), expected_first.end(),
+                                          first.begin(), first.end());
+
+            std::vector<std::string> parents = texts(evaluate(policy, c, descendant("y") | distinct_parent));
+            std::vector<std::string> expected_parents = texts(c | descendant("y") | distinct_parent);
+            BOOST_CHECK_EQUAL_COLLECTIONS(expected_parents.begin(), expected_parents.end(),
+                                          parents.begin(), parents.end());
+
+            // the selectors before take(3) are applied by the workers,
+            // and the ones after it to the joined results
+            auto taken_range = c | descendant("x") | child("y") | take(3) | text;
+            std::vector<std::string> taken_expected(taken_range.begin(), taken_range.end());
+            std::vector<std::string> taken =
+                    evaluate(policy, c, descendant("x") | child("y") | take(3) | text);
+            BOOST_CHECK_EQUAL_COLLECTIONS(taken_expected.begin(), taken_expected.end(),
+                                          taken.begin(), taken.end());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_evaluations_reuse_the_pool)
+{
+    parallel_fixture f;
+    auto c = context(f.root());
+    std::vector<std::string> expected = texts(c | descendant("x"));
+    for (int i = 0; i < 200; ++i) {
+        std::vector<std::string> actual = texts(evaluate(eager(4), c, descendant("x")));
+        BOOST_REQUIRE_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+}
@@ -5,31 +5,37 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include "../scopedmap.hpp"
+#include "../flat_scopedmap.hpp"
 
 #include <unordered_map>
 
+#include <boost/mpl/list.hpp>
 #include <boost/test/unit_test.hpp>
 
 using namespace mediasequencer::plugin::util::xpath;
 
-BOOST_AUTO_TEST_CASE(parent_map_does_not_contain_child_maps_elements)
+// every test is run for both implementations of the scoped map
+typedef boost::mpl::list<scopedmap<std::string, std::string>,
+                         flat_scopedmap<std::string, std::string> > scoped_map_types;
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(parent_map_does_not_contain_child_maps_elements, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values1;
     values1["a"] = "b";
     values1["c"] = "d";
-    scopedmap<std::string, std::string> s1 = s.add(values1.begin(), values1.end());
+    map_type s1 = s.add(values1.begin(), values1.end());
 
     std::unordered_map<std::string, std::string> values2;
     values2["e"] = "f";
     values2["g"] = "h";
-    scopedmap<std::string, std::string> s2 = s1.add(values2.begin(), values2.end());
+    map_type s2 = s1.add(values2.begin(), values2.end());
 
     std::unordered_map<std::string, std::string> values3;
     values3["i"] = "j";
     values3["k"] = "l";
-    scopedmap<std::string, std::string> s3 = s.add(values3.begin(), values3.end());
+    map_type s3 = s.add(values3.begin(), values3.end());
 
     BOOST_CHECK(!s1.get("e"));
     BOOST_CHECK(!s1.get("g"));
@@ -38,66 +44,66 @@ BOOST_AUTO_TEST_CASE(parent_map_does_not_contain_child_maps_elements)
     BOOST_CHECK(!s1.get("k"));
 }
 
-BOOST_AUTO_TEST_CASE(child_map_contains_parent_maps_elements)
+BOOST_AUTO_TEST_CASE_TEMPLATE(child_map_contains_parent_maps_elements, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values1;
     values1["a"] = "b";
     values1["c"] = "d";
-    scopedmap<std::string, std::string> s1 = s.add(values1.begin(), values1.end());
+    map_type s1 = s.add(values1.begin(), values1.end());
 
     std::unordered_map<std::string, std::string> values2;
     values2["e"] = "f";
     values2["g"] = "h";
-    scopedmap<std::string, std::string> s2 = s1.add(values2.begin(), values2.end());
+    map_type s2 = s1.add(values2.begin(), values2.end());
 
     BOOST_CHECK_EQUAL(*s2.get(std::string("a")), std::string("b"));
     BOOST_CHECK_EQUAL(*s2.get(std::string("c")), std::string("d"));
 
 }
 
-BOOST_AUTO_TEST_CASE(leaf_maps_does_not_contain_each_others_elements)
+BOOST_AUTO_TEST_CASE_TEMPLATE(leaf_maps_does_not_contain_each_others_elements, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     // root
     std::unordered_map<std::string, std::string> values;
     values["a"] = "b";
     values["c"] = "d";
-    scopedmap<std::string, std::string> s0 = s.add(values.begin(), values.end());
+    map_type s0 = s.add(values.begin(), values.end());
 
     // line 1
     values.clear();
     values["e"] = "f";
     values["g"] = "h";
-    scopedmap<std::string, std::string> s1 = s0.add(values.begin(), values.end());
+    map_type s1 = s0.add(values.begin(), values.end());
 
     values.clear();
     values["i"] = "j";
     values["k"] = "l";
-    scopedmap<std::string, std::string> s11 = s1.add(values.begin(), values.end());
+    map_type s11 = s1.add(values.begin(), values.end());
 
     values.clear();
     values["m"] = "n";
     values["o"] = "p";
-    scopedmap<std::string, std::string> s12 = s11.add(values.begin(), values.end());
+    map_type s12 = s11.add(values.begin(), values.end());
 
     // line 2
     values.clear();
     values["q"] = "r";
     values["s"] = "t";
-    scopedmap<std::string, std::string> s2 = s0.add(values.begin(), values.end());
+    map_type s2 = s0.add(values.begin(), values.end());
 
     values.clear();
     values["u"] = "v";
     values["w"] = "x";
-    scopedmap<std::string, std::string> s21 = s2.add(values.begin(), values.end());
+    map_type s21 = s2.add(values.begin(), values.end());
 
     values.clear();
     values["y"] = "z";
     values["aa"] = "ab";
-    scopedmap<std::string, std::string> s22 = s21.add(values.begin(), values.end());
+    map_type s22 = s21.add(values.begin(), values.end());
 
     BOOST_CHECK(!s22.get(std::string("e")));
     BOOST_CHECK(!s22.get(std::string("g")));
@@ -115,22 +121,22 @@ BOOST_AUTO_TEST_CASE(leaf_maps_does_not_contain_each_others_elements)
 
 }
 
-BOOST_AUTO_TEST_CASE(deleting_ancestor_before_adding_leaves_elements)
+BOOST_AUTO_TEST_CASE_TEMPLATE(deleting_ancestor_before_adding_leaves_elements, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values;
     values["a"] = "b";
     values["c"] = "d";
-    scopedmap<std::string, std::string> s0 = s.add(values.begin(), values.end());
+    map_type s0 = s.add(values.begin(), values.end());
 
-    scopedmap<std::string, std::string> s11;
+    map_type s11;
     {
 
         values.clear();
         values["e"] = "f";
         values["g"] = "h";
-        scopedmap<std::string, std::string> s1 = s0.add(values.begin(), values.end());
+        map_type s1 = s0.add(values.begin(), values.end());
 
         values.clear();
         values["i"] = "j";
@@ -141,7 +147,7 @@ BOOST_AUTO_TEST_CASE(deleting_ancestor_before_adding_leaves_elements)
     values.clear();
     values["m"] = "n";
     values["o"] = "p";
-    scopedmap<std::string, std::string> s12 = s11.add(values.begin(), values.end());
+    map_type s12 = s11.add(values.begin(), values.end());
 
     BOOST_CHECK_EQUAL(*s12.get(std::string("a")), std::string("b"));
     BOOST_CHECK_EQUAL(*s12.get(std::string("c")), std::string("d"));
@@ -154,24 +160,24 @@ BOOST_AUTO_TEST_CASE(deleting_ancestor_before_adding_leaves_elements)
 
 }
 
-BOOST_AUTO_TEST_CASE(deleting_middle_of_more_lines_does_not_screw_up_scopes)
+BOOST_AUTO_TEST_CASE_TEMPLATE(deleting_middle_of_more_lines_does_not_screw_up_scopes, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values;
     values["a"] = "b";
     values["c"] = "d";
-    scopedmap<std::string, std::string> s0 = s.add(values.begin(), values.end());
+    map_type s0 = s.add(values.begin(), values.end());
 
-    scopedmap<std::string, std::string> s11;
-    scopedmap<std::string, std::string> s21;
-    scopedmap<std::string, std::string> s22;
+    map_type s11;
+    map_type s21;
+    map_type s22;
     {
 
         values.clear();
         values["a"] = "e";
         values["c"] = "f";
-        scopedmap<std::string, std::string> s1 = s0.add(values.begin(), values.end());
+        map_type s1 = s0.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "g";
@@ -181,7 +187,7 @@ BOOST_AUTO_TEST_CASE(deleting_middle_of_more_lines_does_not_screw_up_scopes)
         values.clear();
         values["a"] = "i";
         values["c"] = "j";
-        scopedmap<std::string, std::string> s2 = s0.add(values.begin(), values.end());
+        map_type s2 = s0.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "k";
@@ -198,13 +204,13 @@ BOOST_AUTO_TEST_CASE(deleting_middle_of_more_lines_does_not_screw_up_scopes)
     values.clear();
     values["a"] = "o";
     values["c"] = "p";
-    scopedmap<std::string, std::string> s12 = s11.add(values.begin(), values.end());
+    map_type s12 = s11.add(values.begin(), values.end());
 
 
     values.clear();
     values["a"] = "q";
     values["c"] = "r";
-    scopedmap<std::string, std::string> s23 = s22.add(values.begin(), values.end());
+    map_type s23 = s22.add(values.begin(), values.end());
 
     BOOST_CHECK_EQUAL(*s0.get(std::string("a")), std::string("b"));
     BOOST_CHECK_EQUAL(*s0.get(std::string("c")), std::string("d"));
@@ -220,43 +226,43 @@ BOOST_AUTO_TEST_CASE(deleting_middle_of_more_lines_does_not_screw_up_scopes)
 
 }
 
-BOOST_AUTO_TEST_CASE(deleting_entire_line_does_not_screw_up_scopes)
+BOOST_AUTO_TEST_CASE_TEMPLATE(deleting_entire_line_does_not_screw_up_scopes, map_type, scoped_map_types)
 {
 
-    scopedmap<std::string, std::string> s21;
-    scopedmap<std::string, std::string> s22;
+    map_type s21;
+    map_type s22;
 
     std::unordered_map<std::string, std::string> values;
     {
 
-        scopedmap<std::string, std::string> s;
+        map_type s;
 
         values["a"] = "b";
         values["c"] = "d";
-        scopedmap<std::string, std::string> s0 = s.add(values.begin(), values.end());
+        map_type s0 = s.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "e";
         values["c"] = "f";
         values["z"] = "a";
-        scopedmap<std::string, std::string> s1 = s0.add(values.begin(), values.end());
+        map_type s1 = s0.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "g";
         values["c"] = "h";
         values["z"] = "b";
-        scopedmap<std::string, std::string> s11 = s1.add(values.begin(), values.end());
+        map_type s11 = s1.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "o";
         values["c"] = "p";
         values["z"] = "c";
-        scopedmap<std::string, std::string> s12 = s11.add(values.begin(), values.end());
+        map_type s12 = s11.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "i";
         values["c"] = "j";
-        scopedmap<std::string, std::string> s2 = s0.add(values.begin(), values.end());
+        map_type s2 = s0.add(values.begin(), values.end());
 
         values.clear();
         values["a"] = "k";
@@ -273,21 +279,21 @@ BOOST_AUTO_TEST_CASE(deleting_entire_line_does_not_screw_up_scopes)
     values.clear();
     values["a"] = "o";
     values["c"] = "p";
-    scopedmap<std::string, std::string> s23 = s22.add(values.begin(), values.end());
+    map_type s23 = s22.add(values.begin(), values.end());
 
     values.clear();
     values["a"] = "q";
     values["c"] = "r";
-    scopedmap<std::string, std::string> s24 = s23.add(values.begin(), values.end());
+    map_type s24 = s23.add(values.begin(), values.end());
 
     values.clear();
     values["a"] = "s";
     values["c"] = "t";
-    scopedmap<std::string, std::string> s3 = s21.add(values.begin(), values.end());
+    map_type s3 = s21.add(values.begin(), values.end());
 
     values.clear();
     values["z"] = "d";
-    scopedmap<std::string, std::string> s31 = s3.add(values.begin(), values.end());
+    map_type s31 = s3.add(values.begin(), values.end());
 
     BOOST_CHECK_EQUAL(*s21.get(std::string("a")), std::string("k"));
     BOOST_CHECK_EQUAL(*s21.get(std::string("c")), std::string("l"));
@@ -313,25 +319,25 @@ BOOST_AUTO_TEST_CASE(deleting_entire_line_does_not_screw_up_scopes)
 
 }
 
-BOOST_AUTO_TEST_CASE(sibling_maps_do_not_share_elements_added_to_them_individually)
+BOOST_AUTO_TEST_CASE_TEMPLATE(sibling_maps_do_not_share_elements_added_to_them_individually, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values1;
     values1["a"] = "b";
     values1["c"] = "d";
-    scopedmap<std::string, std::string> s1 = s.add(values1.begin(), values1.end());
+    map_type s1 = s.add(values1.begin(), values1.end());
 
     std::unordered_map<std::string, std::string> values2;
     values2["e"] = "f";
     values2["g"] = "h";
-    scopedmap<std::string, std::string> s2 = s1.add(values2.begin(), values2.end());
+    map_type s2 = s1.add(values2.begin(), values2.end());
 
 
     std::unordered_map<std::string, std::string> values3;
     values3["i"] = "j";
     values3["k"] = "l";
-    scopedmap<std::string, std::string> s3 = s1.add(values3.begin(), values3.end());
+    map_type s3 = s1.add(values3.begin(), values3.end());
 
     BOOST_CHECK(!s2.get(std::string("i")));
     BOOST_CHECK(!s2.get(std::string("k")));
@@ -341,23 +347,23 @@ BOOST_AUTO_TEST_CASE(sibling_maps_do_not_share_elements_added_to_them_individual
 
 }
 
-BOOST_AUTO_TEST_CASE(rvalue_assign_then_delete_does_not_affect_chain)
+BOOST_AUTO_TEST_CASE_TEMPLATE(rvalue_assign_then_delete_does_not_affect_chain, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values1;
     values1["a"] = "b";
     values1["c"] = "d";
-    scopedmap<std::string, std::string> s1 = s.add(values1.begin(), values1.end());
+    map_type s1 = s.add(values1.begin(), values1.end());
 
 
 
-    scopedmap<std::string, std::string> s3;
+    map_type s3;
     {
         std::unordered_map<std::string, std::string> values2;
         values2["e"] = "f";
         values2["g"] = "h";
-        scopedmap<std::string, std::string> s2 = s1.add(values2.begin(), values2.end());
+        map_type s2 = s1.add(values2.begin(), values2.end());
 
         std::unordered_map<std::string, std::string> values3;
         values3["i"] = "j";
@@ -376,27 +382,27 @@ BOOST_AUTO_TEST_CASE(rvalue_assign_then_delete_does_not_affect_chain)
 
 }
 
-BOOST_AUTO_TEST_CASE(const_ref_assign_then_delete_does_not_affect_chain)
+BOOST_AUTO_TEST_CASE_TEMPLATE(const_ref_assign_then_delete_does_not_affect_chain, map_type, scoped_map_types)
 {
-    scopedmap<std::string, std::string> s;
+    map_type s;
 
     std::unordered_map<std::string, std::string> values1;
     values1["a"] = "b";
     values1["c"] = "d";
-    scopedmap<std::string, std::string> s1 = s.add(values1.begin(), values1.end());
+    map_type s1 = s.add(values1.begin(), values1.end());
 
-    scopedmap<std::string, std::string> s3;
+    map_type s3;
     {
         std::unordered_map<std::string, std::string> values2;
         values2["e"] = "f";
         values2["g"] = "h";
-        scopedmap<std::string, std::string> s2 = s1.add(values2.begin(), values2.end());
+        map_type s2 = s1.add(values2.begin(), values2.end());
 
         std::unordered_map<std::string, std::string> values3;
         values3["i"] = "j";
         values3["k"] = "l";
 
-        scopedmap<std::string, std::string> sTemp = s2.add(values3.begin(), values3.end());
+        map_type sTemp = s2.add(values3.begin(), values3.end());
 
         s3 = sTemp;
     }
@@ -411,3 +417,71 @@ BOOST_AUTO_TEST_CASE(const_ref_assign_then_delete_does_not_affect_chain)
     BOOST_CHECK_EQUAL(*s3.get(std::string("k")), std::string("l"));
 
 }
+
+BOOST_AUTO_TEST_CASE(flat_parent_leaves_only_the_innermost_scope)
+{
+    flat_scopedmap<std::string, std::string> s;
+
+    std::unordered_map<std::string, std::string> values;
+    values["a"] = "b";
+    auto s1 = s.add(values.begin(), values.end());
+
+    // a scope without pairs must still be left with one call to parent
+    auto s2 = s1.add(values.end(), values.end());
+
+    values.clear();
+    values["a"] = "c";
+    values["d"] = "e";
+    auto s3 = s2.add(values.begin(), values.end());
+
+    BOOST_CHECK_EQUAL(*s3.get(std::string("a")), std::string("c"));
+
+    auto p2 = s3.parent();
+    BOOST_CHECK_EQUAL(*p2.get(std::string("a")), std::string("b"));
+    BOOST_CHECK(!p2.get(std::string("d")));
+
+    auto p1 = p2.parent();
+    BOOST_CHECK_EQUAL(*p1.get(std::string("a")), std::string("b"));
+
+    BOOST_CHECK(!p1.parent().get(std::string("a")));
+}
+
+BOOST_AUTO_TEST_CASE(flat_arena_is_truncated_when_scopes_are_left)
+{
+    flat_scopedmap<std::string, std::string> root;
+    std::unordered_map<std::string, std::string> values;
+    values["a"] = "b";
+    root = root.add(values.begin(), values.end());
+
+    // walking siblings, each one left before the next is added
+    auto s = root;
+    for (int i = 0; i < 1000; ++i) {
+        values["c"] = std::to_string(i);
+        s = s.add(values.begin(), values.end());
+        BOOST_CHECK_EQUAL(*s.get(std::string("c")), std::to_string(i));
+        s = s.parent();
+    }
+    BOOST_CHECK_EQUAL(1u, root.arena_size());
+
+    // a scope still in use keeps its frames, the others go
+    values.clear();
+    values["d"] = "e";
+    auto kept = root.add(values.begin(), values.end());
+    for (int i = 0; i < 10; ++i) {
+        values["d"] = std::to_string(i);
+        auto leaf = root.add(values.begin(), values.end()).add(values.begin(), values.end());
+        BOOST_CHECK_EQUAL(*leaf.get(std::string("d")), std::to_string(i));
+    }
+    BOOST_CHECK_EQUAL(2u, root.arena_size());
+    BOOST_CHECK_EQUAL(*kept.get(std::string("d")), std::string("e"));
+    BOOST_CHECK_EQUAL(*kept.get(std::string("a")), std::string("b"));
+
+    // a clone has the same scopes in an arena of its own
+    auto clone = kept.clone();
+    BOOST_CHECK_EQUAL(*clone.get(std::string("d")), std::string("e"));
+    BOOST_CHECK_EQUAL(*clone.parent().get(std::string("a")), std::string("b"));
+    BOOST_CHECK(!clone.parent().get(std::string("d")));
+    kept = root;
+    BOOST_CHECK_EQUAL(1u, root.arena_size());
+    BOOST_CHECK_EQUAL(2u, clone.arena_size());
+}
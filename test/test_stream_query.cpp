@@ -0,0 +1,162 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#include "../pugi_adaptor.hpp"
+#include "../compiled_query.hpp"
+#include "../stream_query.hpp"
+
+#include <pugixml.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mediasequencer::plugin::util::xpath;
+
+namespace {
+
+const char* const stream_xml =
+        "<?xml version=\"1.0\"?>\n"
+        "<!DOCTYPE a [ <!ELEMENT a ANY> ]>\n"
+        "<a xmlns:p=\"urn:p\">\n"
+        "  <!-- a comment with <b> in it --->\n"
+        "  <b c=\"d\" id=\"1\">"
+        "    <x><e>one</e></x>"
+        "    <e>two &amp; &#x33;</e>"
+        "  </b>"
+        "  <b c='z' id=\"2\"><e><![CDATA[<three>]]></e></b>"
+        "  <p:b c=\"d\" id=\"3\"><e>four</e></p:b>"
+        "  <f><b c=\"d\" id=\"4\">five<e>six</e></b></f>"
+        "  <e/>"
+        "</a>";
+
+std::vector<std::string> dom_strings(std::string const& query_string,
+                                     namespace_bindings const& namespaces = namespace_bindings()) {
+    std::istringstream iss(stream_xml);
+    pugi::xml_document document;
+    BOOST_REQUIRE(document.load(iss));
+    compiled_query<_context<PugiXmlAdaptor> > q(query_string, namespaces);
+    auto r = q.strings(context(document.root().first_child()));
+    return std::vector<std::string>(r.begin(), r.end());
+}
+
+std::vector<std::string> stream_strings(std::string const& query_string,
+                                        namespace_bindings const& namespaces = namespace_bindings()) {
+    std::istringstream iss(stream_xml);
+    return stream_query(query_string, namespaces).strings(iss);
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(stream_tokenizer_events)
+{
+    // a block size of one tests reading across blocks
+    std::istringstream iss("<a x='1'><b/>t&lt;<![CDATA[c]]><!-- -></a> --></a>");
+    stream_tokenizer tokenizer(iss, 1);
+    stream_event e;
+    std::vector<std::string> events;
+    while (tokenizer.next(e)) {
+        switch (e.kind) {
+        case stream_event::start_tag:
+            events.push_back("<" + e.name + (e.attributes.empty() ? "" : " " + e.attributes[0].second));
+            break;
+        case stream_event::end_tag: events.push_back("/" + e.name); break;
+        case stream_event::characters: events.push_back(e.text); break;
+        }
+    }
+    std::vector<std::string> expected = {"<a 1", "<b", "/b", "t<", "c", "/a"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), events.begin(), events.end());
+}
+
+BOOST_AUTO_TEST_CASE(stream_tokenizer_errors)
+{
+    for (const char* xml: {"<a><b></a>", "<a>", "<a x=1/>", "<a>&nope;</a>", "<a/><b/>", "text<a/>"}) {
+        std::istringstream iss(xml);
+        stream_tokenizer tokenizer(iss);
+        stream_event e;
+        BOOST_CHECK_THROW(while (tokenizer.next(e)) {}, stream_syntax_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stream_query_matches_compiled_query)
+{
+    const namespace_bindings bindings = {{"q", "urn:p"}};
+    for (const char* query_string: {"b/e/text()", "b[@c='d']//e/text()", "//e", "b/@id", "f/*/name()",
+                                    "f//e", "/a/b/@c", "q:b/e", "//b[@c]/@id", "//b", "//b/x/e",
+                                    "//nothing", "/b", "@xmlns:p", "text()"}) {
+        BOOST_TEST_MESSAGE(query_string);
+        std::vector<std::string> expected = dom_strings(query_string, bindings);
+        std::vector<std::string> actual = stream_strings(query_string, bindings);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+    std::vector<std::string> text = stream_strings("b/e/text()");
+    BOOST_REQUIRE_EQUAL(3u, text.size());
+    BOOST_CHECK_EQUAL("two & 3", text[0]);
+    BOOST_CHECK_EQUAL("<three>", text[1]);
+}
+
+BOOST_AUTO_TEST_CASE(stream_query_gives_nodes_once_in_document_order)
+{
+    const char* const nested = "<r><a><a><b id='1'/></a><b id='2'/></a></r>";
+    auto strings = [nested](const char* query) {
+        std::istringstream iss(nested);
+        return stream_query(query).strings(iss);
+    };
+    // the compiled_query gives "2 1" and "1 2 1" on nested a's
+    std::vector<std::string> expected = {"1", "2"};
+    for (const char* query: {"//a/b/@id", "//a//b/@id", "//b/@id", "a//b/@id"}) {
+        BOOST_TEST_MESSAGE(query);
+        std::vector<std::string> actual = strings(query);
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    }
+    std::vector<std::string> names = strings("//a//*/name()");
+    std::vector<std::string> expected_names = {"a", "b", "b"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_names.begin(), expected_names.end(), names.begin(), names.end());
+}
+
+BOOST_AUTO_TEST_CASE(stream_query_emits_while_reading)
+{
+    std::istringstream iss("<a><b>1</b><b>2</b><c>");
+    std::vector<std::string> seen;
+    BOOST_CHECK_THROW(stream_query("b/text()").run(iss, [&seen](std::string const& s) {
+        seen.push_back(s);
+    }), stream_syntax_error);
+    BOOST_CHECK_EQUAL(2u, seen.size());
+}
+
+BOOST_AUTO_TEST_CASE(stream_query_holds_results_inside_elements_waiting_for_text)
+{
+    // the text of the outer b comes after the inner ones, so they are
+    // held until it is read, to keep document order
+    auto seen_before_error = [](const char* xml, const char* query) {
+        std::istringstream iss(xml);
+        std::vector<std::string> seen;
+        BOOST_CHECK_THROW(stream_query(query).run(iss, [&seen](std::string const& s) {
+            seen.push_back(s);
+        }), stream_syntax_error);
+        return seen;
+    };
+    BOOST_CHECK(seen_before_error("<r><b><b>1</b><b>2</b><c>", "//b/text()").empty());
+    BOOST_CHECK_EQUAL(3u, seen_before_error("<r><b>0<b>1</b><b>2</b><c>", "//b/text()").size());
+    BOOST_CHECK_EQUAL(2u, seen_before_error("<r><b><b>1</b><b>2</b><c>", "//b/b/text()").size());
+    // attributes and names are complete when the element starts
+    BOOST_CHECK_EQUAL(3u, seen_before_error("<r><b i='0'><b i='1'/><b i='2'/><c>", "//b/@i").size());
+
+    std::istringstream iss("<r><b><b>1</b><b>2</b>0</b><b/></r>");
+    std::vector<std::string> results = stream_query("//b/text()").strings(iss);
+    std::vector<std::string> expected = {"0", "1", "2", ""};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), results.begin(), results.end());
+}
+
+BOOST_AUTO_TEST_CASE(stream_query_rejects_backward_steps)
+{
+    BOOST_CHECK_THROW(stream_query("b/.."), std::invalid_argument);
+    BOOST_CHECK_THROW(stream_query("b/ancestor::a"), std::invalid_argument);
+    BOOST_CHECK_THROW(stream_query("b[e]"), std::invalid_argument);
+    BOOST_CHECK_THROW(stream_query("q:b"), std::invalid_argument);
+}
@@ -5,13 +5,22 @@
 //          http://www.boost.org/LICENSE_1_0.txt)
 
 #include <boost/range/adaptor/filtered.hpp>
+#include <boost/range/adaptor/transformed.hpp>
 #include <boost/range/distance.hpp>
 
 #include "../pugi_adaptor.hpp"
+#include "../mapped_document.hpp"
+#include "../batch.hpp"
 
 
 #include <pugixml.hpp>
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
 #include <vector>
 
 #define BOOST_TEST_DYN_LINK
@@ -25,9 +34,9 @@ struct xml_fixture {
 
     std::string xml;
     pugi::xml_document document;
-    xml_fixture(std::string xml) : xml(xml) {
-        std::istringstream iss(xml);
-        auto status = document.load(iss);
+    // parsed in place, the nodes point into xml
+    xml_fixture(std::string xml) : xml(std::move(xml)) {
+        auto status = document.load_buffer_inplace(&this->xml[0], this->xml.size());
         BOOST_REQUIRE_MESSAGE(status, "Parsing error: " << status.description());
     }
 
@@ -505,6 +514,277 @@ BOOST_AUTO_TEST_CASE(where_clause_child)
     CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, result_range);
 }
 
+BOOST_AUTO_TEST_CASE(element_only_axes)
+{
+    xml_fixture xml_fixture(
+            "<a xmlns:p='urn:p'>"
+                "t1<!--c-->"
+                "<b>t2<d/></b>"
+                "t3"
+                "<p:c xmlns='urn:x'><d>t4</d><!--e--></p:c>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+    auto c = context(root);
+
+    // name gives the local names
+    std::vector<std::string> expected_names = {"b", "c"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, c | element_child);
+    expected_names = {"b", "d", "c", "d"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, c | element_descendant);
+    expected_names = {"d", "d"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, c | element_child | element_child);
+
+    BOOST_CHECK_EQUAL(1u, c | element_child("c") | count);
+    BOOST_CHECK_EQUAL(0u, c | element_child("d") | count);
+    BOOST_CHECK_EQUAL("t4", c | element_descendant("d") | text | nth(1));
+    BOOST_CHECK_EQUAL(2u, c | element_descendant | where(element_child("d")) | count);
+    BOOST_CHECK_EQUAL(0u, c | element_descendant("d") | element_descendant | count);
+
+    // the same nodes, with the same namespaces, as the other axes
+    auto expected = c | descendant("d") | ns;
+    auto actual = c | element_descendant("d") | ns;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), actual.begin(), actual.end());
+    auto expected_children = c | child("c") | child("d") | ns;
+    auto actual_children = c | element_child("c") | element_child("d") | ns;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_children.begin(), expected_children.end(),
+                                  actual_children.begin(), actual_children.end());
+}
+
+// The pugixml adaptor with the optional functions it does not define,
+// counting the calls
+struct counting_adaptor: PugiXmlAdaptor {
+    static int name_equals_calls;
+    static int child_count_calls;
+    static int attribute_cstr_calls;
+
+    static bool name_equals(pugi::xml_node const& node, const char* local, std::size_t size) {
+        ++name_equals_calls;
+        const char* n = local_name(node.name());
+        return std::strlen(n) == size && std::strncmp(n, local, size) == 0;
+    }
+
+    static std::size_t child_count(pugi::xml_node const& node) {
+        ++child_count_calls;
+        std::size_t n = 0;
+        for (pugi::xml_node c = node.first_child(); c; c = c.next_sibling()) {
+            ++n;
+        }
+        return n;
+    }
+
+    static const char* attribute_cstr(pugi::xml_node const& node, const char* name) {
+        ++attribute_cstr_calls;
+        return PugiXmlAdaptor::attribute_cstr(node, name);
+    }
+};
+
+int counting_adaptor::name_equals_calls = 0;
+int counting_adaptor::child_count_calls = 0;
+int counting_adaptor::attribute_cstr_calls = 0;
+
+BOOST_AUTO_TEST_CASE(adaptor_capabilities)
+{
+    BOOST_CHECK(adaptor_traits<PugiXmlAdaptor>::node_kind);
+    BOOST_CHECK(adaptor_traits<PugiXmlAdaptor>::attribute_cstr);
+    BOOST_CHECK(adaptor_traits<PugiXmlAdaptor>::element_siblings);
+    BOOST_CHECK(!adaptor_traits<PugiXmlAdaptor>::name_cstr);
+    BOOST_CHECK(!adaptor_traits<PugiXmlAdaptor>::name_equals);
+    BOOST_CHECK(!adaptor_traits<PugiXmlAdaptor>::child_count);
+    BOOST_CHECK(adaptor_traits<counting_adaptor>::name_equals);
+    BOOST_CHECK(adaptor_traits<counting_adaptor>::child_count);
+
+    xml_fixture xml_fixture(
+            "<a xmlns:p='urn:p'>"
+                "<b id='1'>t1</b>"
+                "<p:b id='2'/>"
+                "<c id=''><b/></c>"
+                "<b/>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+    BOOST_CHECK(PugiXmlAdaptor::node_kind(root) == node_kind_type::element);
+    BOOST_CHECK(PugiXmlAdaptor::node_kind(root.first_child().first_child()) == node_kind_type::text);
+    BOOST_CHECK(PugiXmlAdaptor::attribute_cstr(root, "id") == nullptr);
+
+    auto c = context(root);
+    _context<counting_adaptor> counted(root);
+
+    // the same results as through the functions every adaptor has
+    BOOST_CHECK_EQUAL(c | descendant("b") | count, counted | descendant("b") | count);
+    BOOST_CHECK_EQUAL(4u, counted | descendant("b") | count);
+    BOOST_CHECK_EQUAL(3u, counted | child("b") | count);
+    BOOST_CHECK_EQUAL(1u, counted | child | attribute("id", "2") | count);
+    // a missing attribute has the empty value
+    BOOST_CHECK_EQUAL(c | child | attribute("id", "") | count,
+                      counted | child | attribute("id", "") | count);
+    BOOST_CHECK_EQUAL(2u, counted | child | attribute("id", "") | count);
+
+    BOOST_CHECK(counting_adaptor::name_equals_calls > 0);
+    BOOST_CHECK(counting_adaptor::child_count_calls > 0);
+    BOOST_CHECK(counting_adaptor::attribute_cstr_calls > 0);
+}
+
+BOOST_AUTO_TEST_CASE(distinct_parents_and_ancestors)
+{
+    xml_fixture xml_fixture(
+            "<r>"
+                "<a>"
+                    "<b><x/><x/><x/></b>"
+                    "<c><x/></c>"
+                "</a>"
+                "<d><x/></d>"
+            "</r>");
+    pugi::xml_node root = xml_fixture.root();
+    auto c = context(root);
+    auto xs = c | descendant("x");
+
+    std::vector<std::string> expected_names = {"b", "b", "b", "c", "d"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, xs | parent);
+
+    expected_names = {"b", "c", "d"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, xs | distinct_parent);
+
+    expected_names = {"r", "a", "b", "c", "d"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, xs | distinct_ancestor);
+    BOOST_CHECK_EQUAL(14u, xs | ancestor | count);
+
+    expected_names = {"a"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, xs | distinct_ancestor("a"));
+    expected_names = {"c"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, xs | distinct_parent("c"));
+
+    // the top element has no ancestors
+    BOOST_CHECK(!(c | distinct_ancestor | exists));
+    BOOST_CHECK(!(c | distinct_parent | exists));
+    BOOST_CHECK_EQUAL(0u, (c | child("q") | distinct_parent | count));
+
+    // the top element in the input does not make its descendants'
+    // ancestors come again
+    auto with_top = boost::join(c, xs);
+    BOOST_CHECK_EQUAL(5u, with_top | distinct_ancestor | count);
+
+    // the ancestors of the inputs are given also when the inputs are
+    // ancestors of each other
+    expected_names = {"r", "a"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, c | descendant("b") | distinct_ancestor);
+    expected_names = {"r", "a", "b"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(
+                expected_names, boost::join(c | descendant("b"), c | descendant("x") | take(1)) | distinct_ancestor);
+
+    auto copy = (xs | distinct_ancestor).begin();
+    ++copy;
+    auto other = copy;
+    ++other;
+    BOOST_CHECK_EQUAL("a", copy->name());
+    BOOST_CHECK_EQUAL("b", other->name());
+
+    BOOST_CHECK_EQUAL(3u, c | descendant | where(distinct_parent("b")) | count);
+}
+
+BOOST_AUTO_TEST_CASE(distinct_parents_and_ancestors_at_mixed_depths)
+{
+    xml_fixture mixed(
+            "<r>"
+                "<a>"
+                    "<b><c/></b>"
+                    "<c/>"
+                "</a>"
+            "</r>");
+    auto c = context(mixed.root());
+
+    // a parent is given when first found, after the parents of the
+    // nodes inside it
+    std::vector<std::string> expected_names = {"b", "a"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, c | descendant("c") | distinct_parent);
+    expected_names = {"r", "a", "b"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected_names, c | descendant("c") | distinct_ancestor);
+
+    // every node of a deep chain is at another depth than the one
+    // before, each ancestor is still given once, top down
+    const int depth = 3000;
+    std::string xml = "<a>";
+    for (int i = 1; i < depth; ++i) {
+        xml += "<a>";
+    }
+    for (int i = 0; i < depth; ++i) {
+        xml += "<b/></a>";
+    }
+    xml_fixture chain(xml);
+    auto top = context(chain.root());
+    auto bs = top | descendant("b");
+    BOOST_CHECK_EQUAL(std::size_t(depth), bs | count);
+    BOOST_CHECK_EQUAL(std::size_t(depth), bs | distinct_ancestor | count);
+    BOOST_CHECK_EQUAL(std::size_t(depth), bs | distinct_parent | count);
+    auto firsts = bs | distinct_ancestor;
+    auto first = firsts.begin();
+    ++first;
+    BOOST_CHECK(first->get_node() == chain.root().first_child());
+}
+
+BOOST_AUTO_TEST_CASE(distinct_descendants_of_nested_nodes)
+{
+    xml_fixture xml_fixture(
+            "<r>"
+                "<a id='1'>"
+                    "<a id='2'><b>1</b></a>"
+                    "<b>2</b>"
+                "</a>"
+                "<c><a id='3'><b>3</b></a></c>"
+            "</r>");
+    pugi::xml_node root = xml_fixture.root();
+    auto c = context(root);
+
+    // the subtree of the inner a is walked twice by descendant
+    std::vector<std::string> repeated = {"1", "2", "1", "3"};
+    auto all = c | descendant("a") | descendant("b") | text;
+    BOOST_CHECK_EQUAL_COLLECTIONS(repeated.begin(), repeated.end(),
+                                  all.begin(), all.end());
+
+    std::vector<std::string> expected = {"1", "2", "3"};
+    auto distinct = c | descendant("a") | distinct_descendant("b") | text;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  distinct.begin(), distinct.end());
+
+    BOOST_CHECK_EQUAL(7u, c | descendant("a") | distinct_descendant | count);
+    BOOST_CHECK_EQUAL(9u, c | descendant("a") | descendant | count);
+
+    // the same node twice in the input is walked once
+    auto twice = boost::join(c | child("a"), c | child("a"));
+    BOOST_CHECK_EQUAL(2u, twice | distinct_descendant("b") | count);
+
+    // inputs after the subtree are walked again
+    BOOST_CHECK_EQUAL(3u, c | child | distinct_descendant("b") | count);
+
+    BOOST_CHECK_EQUAL(1u, c | child | where(distinct_descendant("b") | text_contains("3")) | count);
+}
+
+BOOST_AUTO_TEST_CASE(distinct_descendants_of_deep_chain)
+{
+    // every a is inside all a before it, each b is found once from the
+    // outermost a and the inner ones are skipped without a climb
+    const int depth = 5000;
+    std::string xml = "<r>";
+    for (int i = 0; i < depth; ++i) {
+        xml += "<a><b>" + std::to_string(i) + "</b>";
+    }
+    for (int i = 0; i < depth; ++i) {
+        xml += "</a>";
+    }
+    xml += "</r>";
+    xml_fixture xml_fixture(xml);
+    auto c = context(xml_fixture.root());
+
+    std::vector<std::string> expected;
+    for (int i = 0; i < depth; ++i) {
+        expected.push_back(std::to_string(i));
+    }
+    auto distinct = c | descendant("a") | distinct_descendant("b") | text;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  distinct.begin(), distinct.end());
+
+    // the inner a, the b and their texts
+    BOOST_CHECK_EQUAL(3u * depth - 1, c | descendant("a") | distinct_descendant | count);
+}
+
 BOOST_AUTO_TEST_CASE(where_clause_descendant_parent)
 {
     xml_fixture xml_fixture(
@@ -618,6 +898,180 @@ BOOST_AUTO_TEST_CASE(namespace_selector_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(linked_namespaces_selector)
+{
+    xml_fixture xml_fixture(
+            "<a xmlns:foo=\"a:a\">"
+                "<foo:z/>"
+                "<b xmlns=\"a:b\">"
+                    "<x xmlns:foo=\"a:c\">"
+                        "<foo:s xmlns=\"a:d\"/>"
+                        "<t/>"
+                    "</x>"
+                    "<foo:y/>"
+                "</b>"
+                "<y/>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+
+    auto node_range = singleton(context<linked_namespaces>(root));
+    auto result_range = node_range | descendant | ns;
+
+    std::vector<std::string> expected_namespaces = {"a:a", "a:b", "a:b", "a:c", "a:b", "a:a", ""};
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_namespaces.begin(), expected_namespaces.end(),
+                                  result_range.begin(), result_range.end());
+
+    auto default_range = singleton(context(root)) | descendant | ns;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_namespaces.begin(), expected_namespaces.end(),
+                                  default_range.begin(), default_range.end());
+
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(
+                std::vector<std::string>({"b", "x", "t"}),
+                node_range | descendant | where(ns("a:b")));
+}
+
+BOOST_AUTO_TEST_CASE(lazy_namespaces_selector)
+{
+    xml_fixture xml_fixture(
+            "<a xmlns:foo=\"a:a\">"
+                "<foo:z/>"
+                "<b xmlns=\"a:b\">"
+                    "<x xmlns:foo=\"a:c\">"
+                        "<foo:s xmlns=\"a:d\"/>"
+                        "<t/>"
+                    "</x>"
+                    "<foo:y/>"
+                "</b>"
+                "<y/>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+
+    auto node_range = singleton(context<lazy_namespaces>(root));
+
+    // twice, so that the second pass is answered from the memo
+    for (int i = 0; i < 2; ++i) {
+        auto result_range = node_range | descendant | ns;
+
+        std::vector<std::string> expected_namespaces = {"a:a", "a:b", "a:b", "a:c", "a:b", "a:a", ""};
+
+        BOOST_CHECK_EQUAL_COLLECTIONS(expected_namespaces.begin(), expected_namespaces.end(),
+                                      result_range.begin(), result_range.end());
+    }
+
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(
+                std::vector<std::string>({"s"}),
+                node_range | descendant | where(ns("a:c")));
+
+    // queries from one root context in several threads, each with the
+    // memo of its own traversal
+    std::vector<std::string> expected_namespaces = {"a:a", "a:b", "a:b", "a:c", "a:b", "a:a", ""};
+    std::vector<int> matching(4, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < matching.size(); ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 50; ++i) {
+                auto result_range = node_range | descendant | ns;
+                std::vector<std::string> result(result_range.begin(), result_range.end());
+                matching[t] += result == expected_namespaces;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (int m: matching) {
+        BOOST_CHECK_EQUAL(50, m);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(flat_namespaces_selector)
+{
+    xml_fixture xml_fixture(
+            "<a xmlns:foo=\"a:a\">"
+                "<foo:z/>"
+                "<b xmlns=\"a:b\">"
+                    "<x xmlns:foo=\"a:c\">"
+                        "<foo:s xmlns=\"a:d\"/>"
+                        "<t/>"
+                    "</x>"
+                    "<foo:y/>"
+                "</b>"
+                "<y/>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+
+    auto node_range = singleton(context<flat_namespaces>(root));
+    auto result_range = node_range | descendant | ns;
+
+    std::vector<std::string> expected_namespaces = {"a:a", "a:b", "a:b", "a:c", "a:b", "a:a", ""};
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_namespaces.begin(), expected_namespaces.end(),
+                                  result_range.begin(), result_range.end());
+
+    auto s = root.child("b").child("x").child("foo:s");
+    auto from_leaf = singleton(context<flat_namespaces>(s)) | ancestor | ns;
+    expected_namespaces = {"a:b", "a:b", ""};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_namespaces.begin(), expected_namespaces.end(),
+                                  from_leaf.begin(), from_leaf.end());
+
+    // the results keep their scopes after the traversal has left them
+    std::vector<_context<PugiXmlAdaptor, pugi::xml_node, flat_namespaces<PugiXmlAdaptor> > > kept(
+            (node_range | descendant).begin(), (node_range | descendant).end());
+    expected_namespaces = {"a:a", "a:b", "a:b", "a:c", "a:b", "a:a", ""};
+    std::vector<std::string> kept_namespaces;
+    for (auto const& k: kept) {
+        auto n = singleton(k) | ns;
+        kept_namespaces.push_back(*n.begin());
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_namespaces.begin(), expected_namespaces.end(),
+                                  kept_namespaces.begin(), kept_namespaces.end());
+
+    // queries from one root context in several threads, each in the
+    // arena of its own traversal
+    std::vector<int> matching(4, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < matching.size(); ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 50; ++i) {
+                auto result_range = node_range | descendant | ns;
+                std::vector<std::string> result(result_range.begin(), result_range.end());
+                matching[t] += result == expected_namespaces;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (int m: matching) {
+        BOOST_CHECK_EQUAL(50, m);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prefixed_names_match_local_name)
+{
+    xml_fixture xml_fixture(
+            "<a xmlns:p=\"p:p\" xmlns:q=\"q:q\">"
+                "<p:b><c/></p:b>"
+                "<b/>"
+                "<q:bb/>"
+                "<q:b/>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+
+    BOOST_CHECK(selector_name("b") == selector_name(std::string("b")));
+    BOOST_CHECK(selector_name("b") != selector_name("bb"));
+    BOOST_CHECK(selector_name("b").matches_local("p:b"));
+    BOOST_CHECK(!selector_name("b").matches_local("p:bb"));
+
+    std::vector<std::string> expected = {"b", "b", "b"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected, context(root) | child("b"));
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(expected, context(root) | descendant("b"));
+
+    std::vector<std::string> parents = {"b"};
+    CHECK_EXPECTED_NAMES_RANGE_EQUAL_NODE_RANGE_NAMES(parents, context(root) | descendant("c") | parent("b"));
+}
+
 BOOST_AUTO_TEST_CASE(attribute_selector)
 {
     xml_fixture xml_fixture(
@@ -782,6 +1236,48 @@ BOOST_AUTO_TEST_CASE(text_selector)
     BOOST_CHECK(result_it == result_range.end());
 }
 
+BOOST_AUTO_TEST_CASE(view_selectors)
+{
+    xml_fixture xml_fixture(
+            "<a>"
+                "<p:z xmlns:p=\"p:p\" id=\"1\">foo</p:z>"
+                "<b>bar</b>"
+                "<z id=\"\">baz</z>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+
+    auto texts = context(root) | child("z") | text_view;
+    std::vector<std::string> expected_text = {"foo", "baz"};
+    std::vector<std::string> actual_text;
+    for (string_view s: texts) {
+        actual_text.push_back(std::string(s.begin(), s.end()));
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_text.begin(), expected_text.end(),
+                                  actual_text.begin(), actual_text.end());
+
+    auto names = context(root) | child | name_view;
+    std::vector<std::string> expected_names = {"z", "b", "z"};
+    std::vector<std::string> actual_names;
+    for (string_view s: names) {
+        actual_names.push_back(std::string(s.begin(), s.end()));
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_names.begin(), expected_names.end(),
+                                  actual_names.begin(), actual_names.end());
+
+    // the empty value is kept, the node without the attribute is skipped
+    auto ids = context(root) | child | attribute_view("id");
+    std::vector<std::string> expected_ids = {"1", ""};
+    std::vector<std::string> actual_ids;
+    for (string_view s: ids) {
+        actual_ids.push_back(std::string(s.begin(), s.end()));
+    }
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_ids.begin(), expected_ids.end(),
+                                  actual_ids.begin(), actual_ids.end());
+
+    BOOST_CHECK_EQUAL("foo,baz", context(root) | child("z") | text_view | concatenate(","));
+    BOOST_CHECK_EQUAL(2, boost::distance(context(root) | child | where(attribute_view("id"))));
+}
+
 BOOST_AUTO_TEST_CASE(text_selector_contains)
 {
     xml_fixture xml_fixture(
@@ -841,6 +1337,81 @@ int count_ds(range<_context<PugiXmlAdaptor> > r) {
   return boost::distance( r | child("d"));
 }
 
+// counts how often it is called, to check that the terminal
+// selectors make a single pass
+struct counting_name_predicate {
+    typedef bool result_type;
+    bool operator()(_context<PugiXmlAdaptor> const& c) const {
+        ++*calls;
+        return c.name() == name;
+    }
+    std::string name;
+    int* calls;
+};
+
+BOOST_AUTO_TEST_CASE(terminal_selectors)
+{
+    xml_fixture xml_fixture(
+            "<a>"
+                "<b/><c>1</c><b/><c>2</c><c>3</c>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+    auto c = context(root);
+
+    int calls = 0;
+    counting_name_predicate is_c = {"c", &calls};
+    // the filtered range finds its first entry when it is made
+    auto cs = c | child | boost::adaptors::filtered(is_c);
+    BOOST_CHECK_EQUAL(2, calls);
+
+    calls = 0;
+    BOOST_CHECK_EQUAL("1", (cs | first).text());
+    BOOST_CHECK_EQUAL(0, calls);
+
+    BOOST_CHECK(cs | exists);
+    BOOST_CHECK_EQUAL(0, calls);
+
+    BOOST_CHECK_EQUAL(3u, cs | count);
+    BOOST_CHECK_EQUAL(3, calls);
+
+    calls = 0;
+    BOOST_CHECK_EQUAL("2", (cs | nth(1)).text());
+    BOOST_CHECK_EQUAL(2, calls);
+
+    BOOST_CHECK((cs | nth(3)).is_null());
+    BOOST_CHECK(!(c | child("d") | exists));
+    BOOST_CHECK_EQUAL(0u, c | child("d") | count);
+    BOOST_CHECK_EQUAL(3u, c | child | where(child) | count);
+    BOOST_CHECK_EQUAL("3", c | child("c") | text | nth(2));
+}
+
+BOOST_AUTO_TEST_CASE(take_selector)
+{
+    xml_fixture xml_fixture(
+            "<a>"
+                "<c>1</c><b><c>2</c></b><c>3</c><b/><c>4</c>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+    auto c = context(root);
+
+    std::vector<std::string> expected = {"1", "2"};
+    auto first_two = c | descendant("c") | take(2) | text;
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  first_two.begin(), first_two.end());
+
+    BOOST_CHECK_EQUAL(0u, c | descendant("c") | take(0) | count);
+    BOOST_CHECK_EQUAL(4u, c | descendant("c") | take(10) | count);
+
+    // the nodes after the last one taken are not visited, also
+    // through a type erased range. 4 of the 10 descendants are visited
+    int calls = 0;
+    counting_name_predicate is_c = {"c", &calls};
+    range<_context<PugiXmlAdaptor> > erased =
+            c | descendant | boost::adaptors::filtered(is_c) | take(2);
+    BOOST_CHECK_EQUAL(2u, erased | count);
+    BOOST_CHECK_EQUAL(4, calls);
+}
+
 BOOST_AUTO_TEST_CASE(type_erasure)
 {
     xml_fixture xml_fixture(
@@ -862,6 +1433,202 @@ BOOST_AUTO_TEST_CASE(type_erasure)
     BOOST_CHECK_EQUAL(count, 3);
 }
 
+// counts the entries read from the range
+struct counting_even {
+    typedef bool result_type;
+    bool operator()(int i) const {
+        ++*calls;
+        return i % 2 == 0;
+    }
+    int* calls;
+};
+
+// counts the copies made of it
+struct counting_copies {
+    explicit counting_copies(int* copies) : copies(copies) {}
+    counting_copies(counting_copies const& other) : copies(other.copies) {
+        ++*copies;
+    }
+    counting_copies& operator=(counting_copies const& other) {
+        copies = other.copies;
+        ++*copies;
+        return *this;
+    }
+    int* copies;
+};
+
+struct int_to_string {
+    typedef std::string result_type;
+    std::string operator()(int i) const {
+        return std::to_string(i);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(erased_range_iterators)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 300; ++i) {
+        numbers.push_back(i);
+    }
+    int calls = 0;
+    counting_even is_even = {&calls};
+    range<int> evens = numbers | boost::adaptors::filtered(is_even);
+    calls = 0;
+
+    // the filtered range found the first entry when it was made, and
+    // the range is not read ahead of the entry that is used
+    BOOST_CHECK_EQUAL(0, *evens.begin());
+    BOOST_CHECK_EQUAL(0, calls);
+    auto first = evens.begin();
+    ++first;
+    BOOST_CHECK_EQUAL(2, *first);
+    BOOST_CHECK_EQUAL(2, calls);
+    BOOST_CHECK(!evens.empty());
+
+    BOOST_CHECK_EQUAL(150, boost::distance(evens));
+
+    // a copy goes on from where it was made, independent of the original
+    auto i = evens.begin();
+    std::advance(i, 100);
+    auto j = i;
+    BOOST_CHECK(i == j);
+    BOOST_CHECK_EQUAL(200, *j);
+    ++i;
+    BOOST_CHECK(i != j);
+    BOOST_CHECK_EQUAL(202, *i);
+    BOOST_CHECK_EQUAL(200, *j);
+    BOOST_CHECK_EQUAL(50, std::distance(j, evens.end()));
+    BOOST_CHECK_EQUAL(49, std::distance(i, evens.end()));
+
+    // a moved iterator takes the position, and leaves the end
+    auto k = std::move(j);
+    BOOST_CHECK_EQUAL(200, *k);
+    BOOST_CHECK(j == evens.end());
+    j = std::move(k);
+    BOOST_CHECK_EQUAL(200, *j);
+    BOOST_CHECK_EQUAL(50, std::distance(j, evens.end()));
+
+    std::vector<int> none;
+    range<int> empty = none;
+    BOOST_CHECK(empty.empty());
+    BOOST_CHECK(empty.begin() == empty.end());
+}
+
+BOOST_AUTO_TEST_CASE(erased_range_does_not_copy_entries)
+{
+    int copies = 0;
+    std::vector<counting_copies> entries(100, counting_copies(&copies));
+    copies = 0;
+    // the range is kept by value, so a vector would be copied
+    range<counting_copies> r = boost::make_iterator_range(entries);
+    auto i = r.begin();
+    for (; i != r.end(); ++i) {
+        BOOST_CHECK(&*i >= entries.data() && &*i < entries.data() + entries.size());
+    }
+    BOOST_CHECK_EQUAL(0, copies);
+
+    // entries given by value are kept for the position, and copied
+    // with it
+    std::vector<int> numbers = {1, 2, 3, 4, 5};
+    range<std::string> strings = numbers | boost::adaptors::transformed(int_to_string());
+    auto s = strings.begin();
+    ++s;
+    auto t = s;
+    ++s;
+    BOOST_CHECK_EQUAL("2", *t);
+    BOOST_CHECK_EQUAL("3", *s);
+    std::string batch[4];
+    BOOST_CHECK_EQUAL(3u, next_batch(s, strings.end(), batch, 4));
+    BOOST_CHECK_EQUAL("3", batch[0]);
+    BOOST_CHECK_EQUAL("5", batch[2]);
+    BOOST_CHECK(s == strings.end());
+    BOOST_CHECK_EQUAL(2u, next_batch(t, strings.end(), batch, 2));
+    BOOST_CHECK_EQUAL("3", batch[1]);
+    BOOST_CHECK_EQUAL("4", *t);
+}
+
+BOOST_AUTO_TEST_CASE(for_each_batch_fills_buffers)
+{
+    xml_fixture xml_fixture(
+            "<a>"
+                "<c>1</c><b><c>2</c></b><c>3</c><b/><c>4</c><c>5</c>"
+            "</a>");
+    pugi::xml_node root = xml_fixture.root();
+    auto c = context(root);
+    typedef _context<PugiXmlAdaptor> C;
+
+    std::vector<std::size_t> sizes;
+    std::vector<std::string> texts;
+    auto collect = [&](batch_range<C> batch) {
+        sizes.push_back(batch.size());
+        for (C const& e: batch) {
+            texts.push_back(e.text());
+        }
+    };
+    std::vector<std::string> expected = {"1", "2", "3", "4", "5"};
+
+    BOOST_CHECK_EQUAL(5u, for_each_batch(c | descendant("c"), collect, 2));
+    std::vector<std::size_t> expected_sizes = {2, 2, 1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_sizes.begin(), expected_sizes.end(),
+                                  sizes.begin(), sizes.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  texts.begin(), texts.end());
+
+    // through a type erased range the entries are copied with one
+    // virtual call per batch, once the array is filled
+    sizes.clear();
+    texts.clear();
+    range<C> erased = c | descendant("c");
+    BOOST_CHECK_EQUAL(5u, for_each_batch(erased, collect, 4));
+    expected_sizes = {4, 1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_sizes.begin(), expected_sizes.end(),
+                                  sizes.begin(), sizes.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  texts.begin(), texts.end());
+
+    // a range filling the last batch exactly gives no empty batch
+    sizes.clear();
+    BOOST_CHECK_EQUAL(4u, for_each_batch(c | child("c"), collect, 2));
+    BOOST_CHECK_EQUAL(2u, sizes.size());
+
+    BOOST_CHECK_EQUAL(0u, for_each_batch(c | child("d"), collect));
+    BOOST_CHECK_THROW(for_each_batch(erased, collect, 0), std::invalid_argument);
+
+    // the nodes only
+    sizes.clear();
+    texts.clear();
+    BOOST_CHECK_EQUAL(5u, for_each_node_batch(erased, [&](batch_range<pugi::xml_node> nodes) {
+        sizes.push_back(nodes.size());
+        for (pugi::xml_node const& n: nodes) {
+            texts.push_back(n.child_value());
+        }
+    }, 2));
+    expected_sizes = {2, 2, 1};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected_sizes.begin(), expected_sizes.end(),
+                                  sizes.begin(), sizes.end());
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(),
+                                  texts.begin(), texts.end());
+    BOOST_CHECK_THROW(for_each_node_batch(erased, [](batch_range<pugi::xml_node>) {}, 0),
+                      std::invalid_argument);
+
+    // the array is not made of default constructed entries, each entry
+    // is copied into it once
+    int copies = 0;
+    std::vector<counting_copies> entries(5, counting_copies(&copies));
+    copies = 0;
+    BOOST_CHECK_EQUAL(5u, for_each_batch(boost::make_iterator_range(entries),
+                                         [](batch_range<counting_copies>) {}, 2));
+    BOOST_CHECK_EQUAL(5, copies);
+
+    // next_batch goes on from where the iterator is
+    auto i = erased.begin();
+    ++i;
+    C out[3];
+    BOOST_CHECK_EQUAL(3u, next_batch(i, erased.end(), out, 3));
+    BOOST_CHECK_EQUAL("4", out[2].text());
+    BOOST_CHECK_EQUAL("5", i->text());
+}
+
 BOOST_AUTO_TEST_CASE(weird_combinations)
 {
     xml_fixture xml_fixture("<a><b><c xmlns=\"hei\" hei=\"foo\"></c></b></a>");
@@ -895,3 +1662,30 @@ BOOST_AUTO_TEST_CASE(weird_combinations)
 }
 
 
+
+BOOST_AUTO_TEST_CASE(mapped_document_parses_in_place)
+{
+    char name[] = "/tmp/xtpath_mapped_XXXXXX";
+    ::close(::mkstemp(name));
+    std::string path = name;
+    {
+        std::ofstream file(path);
+        file << "<a><b id=\"1\">one</b><b id=\"2\">two</b></a>";
+    }
+    auto doc = map_document(path);
+    auto texts = context(doc->root()) | child("b") | text;
+    std::vector<std::string> expected = {"one", "two"};
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), texts.begin(), texts.end());
+    // the file is not changed by parsing
+    std::ifstream file(path);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    BOOST_CHECK_EQUAL("<a><b id=\"1\">one</b><b id=\"2\">two</b></a>", content);
+
+    {
+        std::ofstream bad(path);
+        bad << "<a><b></a>";
+    }
+    BOOST_CHECK_THROW(map_document(path), mapped_document_error);
+    std::remove(path.c_str());
+    BOOST_CHECK_THROW(map_document(path), std::system_error);
+}
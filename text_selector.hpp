@@ -7,7 +7,7 @@
 #ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TEXT_SELECTOR_HPP
 #define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_TEXT_SELECTOR_HPP
 
-#include <numeric>
+#include <string>
 
 namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
 
@@ -116,15 +116,20 @@ operator|(Range const& range, text_contains p)
                 node_contains_text<typename Range::iterator::value_type>(p.text));
 }
 
-// Implements the pipe operator for the concatenate selector
+// Implements the pipe operator for the concatenate selector. The
+// input may be strings or string views, e.g. 'range | text_view'
 template<typename Range>
 std::string
 operator|(Range const& range, concatenate c) {
-    return
-            std::accumulate(
-                range.begin(), range.end(), std::string(""),
-                [c](std::string& v, std::string const& x)
-                { return v +(v.size()==0?"":c.delimiter)+x; }   );
+    std::string result;
+    for (auto i = range.begin(); i != range.end(); ++i) {
+        auto&& x = *i;
+        if (!result.empty()) {
+            result += c.delimiter;
+        }
+        result.append(x.begin(), x.end());
+    }
+    return result;
 }
 
 // Implements the pipe operator for the xml_string selector
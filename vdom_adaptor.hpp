@@ -54,6 +54,23 @@ struct VdomAdaptor {
         return node.next_sibling();
     }
 
+    // the first child, or next sibling, that is not text
+    static vdom::node first_element_child(vdom::node const& node) {
+        vdom::node n = first_child(node);
+        while (!n.is_null() && n.type() == vdom::node::TEXT) {
+            n = n.next_sibling();
+        }
+        return n;
+    }
+
+    static vdom::node next_element_sibling(vdom::node const& node) {
+        vdom::node n = node.next_sibling();
+        while (!n.is_null() && n.type() == vdom::node::TEXT) {
+            n = n.next_sibling();
+        }
+        return n;
+    }
+
     static vdom::node parent(vdom::node const& node) {
         return node.is_null() ? vdom::node::null : node.parent();
     }
@@ -62,6 +79,12 @@ struct VdomAdaptor {
         return node.number_of_children() > 0;
     }
 
+    // the number of children, kept by vdom. Optional, see
+    // adaptor_traits.hpp
+    static std::size_t child_count(vdom::node const& node) {
+        return node.number_of_children();
+    }
+
     static bool has_next_sibling(vdom::node const& node) {
         return !node.next_sibling().is_null();
     }
@@ -74,6 +97,10 @@ struct VdomAdaptor {
         return node.is_null();
     }
 
+    static auto name(vdom::node const& node) -> decltype(node.name()) {
+        return node.name();
+    }
+
     static std::string to_text(vdom::node const& node) {
         return mediasequencer::vdom::treeutil::element_to_xml(node);
     }
@@ -122,6 +149,12 @@ inline
 _context<VdomAdaptor> context(mediasequencer::vdom::node const &n) {
     return _context<VdomAdaptor>(n);
 }
+
+template <template <typename> class Namespaces>
+_context<VdomAdaptor, vdom::node, Namespaces<VdomAdaptor> >
+context(mediasequencer::vdom::node const &n) {
+    return _context<VdomAdaptor, vdom::node, Namespaces<VdomAdaptor> >(n);
+}
 }
 
 }}}}
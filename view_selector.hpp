@@ -0,0 +1,207 @@
+
+//          Copyright Morten Bendiksen 2014 - 2016.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+
+#ifndef MEDIASEQUENCER_PLUGIN_UTIL_XPATH_VIEW_SELECTOR_HPP
+#define MEDIASEQUENCER_PLUGIN_UTIL_XPATH_VIEW_SELECTOR_HPP
+
+#include "selector_common.hpp"
+#include "selector_name.hpp"
+
+#include <boost/iterator/iterator_facade.hpp>
+#include <boost/range/adaptor/transformed.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <boost/utility/string_ref.hpp>
+
+#include <memory>
+#include <string>
+
+namespace mediasequencer { namespace plugin { namespace util { namespace xpath {
+
+// The view selectors give the same strings as text, name and
+// attribute("foo"), but as string_refs pointing into the document
+// instead of copies. The views are valid as long as the document is
+// not modified or destroyed. They need an adaptor that defines
+// text_view(node) and attribute_view(node, name), see pugi_adaptor.hpp
+typedef boost::string_ref string_view;
+
+// the type for the text_view selector
+struct _text_view {
+
+};
+
+// the type for the name_view selector
+struct _name_view {
+
+};
+
+// the attribute_view selector filtered on the name of the attribute
+struct filtered_attribute_view {
+    explicit filtered_attribute_view(std::string name): name(std::move(name)) {
+    }
+
+    std::string name;
+};
+
+// the type for the attribute_view selector
+class _attribute_view {
+public:
+    filtered_attribute_view operator()(std::string name) const {
+        return filtered_attribute_view(std::move(name));
+    }
+};
+
+namespace {
+    /// The text_view selector. Gives the text content of the nodes in the
+    /// input as a range of string views, e.g. 'range | text_view'
+    const _text_view text_view;
+    /// The name_view selector. Gives the names of the nodes in the input
+    /// without prefix as a range of string views, e.g. 'range | name_view'
+    const _name_view name_view;
+    /// The attribute_view selector. Gives the values of the attributes
+    /// with the given name as a range of string views,
+    /// e.g. 'range | attribute_view("foo")'
+    const _attribute_view attribute_view;
+}
+
+// Used to transform a context node to a view of its text content
+template <typename Context>
+struct node_to_text_view {
+    typedef string_view result_type;
+    string_view operator()(Context const& c) const {
+        return c.text_view();
+    }
+};
+
+// Used to transform a context node to a view of its local name
+template <typename Context>
+struct node_to_name_view {
+    typedef string_view result_type;
+    string_view operator()(Context const& c) const {
+        return string_view(local_name(c.raw_name()));
+    }
+};
+
+// An iterator over the values of the attributes with a given name.
+// It is given a range of nodes and skips the nodes that do not have the
+// attribute, so every attribute is looked up once.
+template <typename ParentIterator>
+class attribute_view_iterator : public boost::iterator_facade<
+        attribute_view_iterator<ParentIterator>,
+        string_view,
+        boost::forward_traversal_tag,
+        string_view> {
+public:
+    attribute_view_iterator() {}
+
+    attribute_view_iterator(ParentIterator const& end)
+        : parent_it(end), parent_end(end) {}
+
+    attribute_view_iterator(ParentIterator begin, ParentIterator end,
+                            std::shared_ptr<const std::string> name)
+        : parent_it(begin), parent_end(end), name(std::move(name)) {
+        find_attribute();
+    }
+
+    void increment() {
+        ++parent_it;
+        find_attribute();
+    }
+
+    bool equal(attribute_view_iterator const& other) const {
+        return parent_it == other.parent_it;
+    }
+
+    string_view dereference() const {
+        return value;
+    }
+
+private:
+    // moves to the first node from parent_it which has the attribute
+    void find_attribute() {
+        for (; parent_it != parent_end; ++parent_it) {
+            value = (*parent_it).attribute_view(*name);
+            if (value.data()) {
+                return;
+            }
+        }
+    }
+
+    ParentIterator parent_it;
+    ParentIterator parent_end;
+    // shared with the range, so the iterators may outlive it
+    std::shared_ptr<const std::string> name;
+    string_view value;
+};
+
+// A range of attribute values. The name of the attribute is
+// allocated once and shared by the iterators
+template <typename Range>
+class attribute_view_range {
+public:
+    typedef attribute_view_iterator<typename Range::iterator> iterator;
+    typedef iterator const_iterator;
+
+    attribute_view_range(Range const& range, std::string name)
+        : range(range), name(new std::string(std::move(name))) {
+    }
+
+    iterator begin() const {
+        return iterator(range.begin(), range.end(), name);
+    }
+
+    iterator end() const {
+        return iterator(range.end());
+    }
+
+private:
+    Range range;
+    std::shared_ptr<const std::string> name;
+};
+
+// Implements the pipe operator for the text_view selector
+template<typename Range>
+boost::range_detail::transformed_range
+<node_to_text_view<typename Range::iterator::value_type>,
+ const Range>
+operator|(Range const& range, _text_view)
+{
+    return range | boost::adaptors::transformed(node_to_text_view<typename Range::iterator::value_type>());
+}
+
+// Implements the pipe operator for the name_view selector
+template<typename Range>
+boost::range_detail::transformed_range
+<node_to_name_view<typename Range::iterator::value_type>,
+ const Range>
+operator|(Range const& range, _name_view)
+{
+    return range | boost::adaptors::transformed(node_to_name_view<typename Range::iterator::value_type>());
+}
+
+// Implements the pipe operator for the attribute_view selector
+template<typename Range>
+attribute_view_range<Range>
+operator|(Range const& range, filtered_attribute_view f)
+{
+    return attribute_view_range<Range>(range, std::move(f.name));
+}
+
+// enables the view selectors in sub expressions
+template <>
+struct is_expr<_text_view>: std::true_type {
+};
+
+template <>
+struct is_expr<_name_view>: std::true_type {
+};
+
+template <>
+struct is_expr<filtered_attribute_view>: std::true_type {
+};
+
+}}}}
+
+#endif // MEDIASEQUENCER_PLUGIN_UTIL_XPATH_VIEW_SELECTOR_HPP
@@ -18,6 +18,9 @@
 #include "namespace_selector.hpp"
 #include "attribute_selector.hpp"
 #include "text_selector.hpp"
+#include "view_selector.hpp"
+#include "take_selector.hpp"
+#include "compiled_query.hpp"
 
 #include <boost/range/join.hpp>
 
@@ -88,6 +91,19 @@ template <typename Left, typename Right>
 struct is_expr<or_expression<Left, Right> >: std::true_type {
 };
 
+// a piped expression needs the whole range when either side does
+template <typename Left, typename Right>
+struct is_range_selector<piped_expression<Left, Right> >
+    : std::integral_constant<bool, is_range_selector<Left>::value
+                                   || is_range_selector<Right>::value> {
+};
+
+// an or_expression gives the results of the left side for the whole
+// range before those of the right side
+template <typename Left, typename Right>
+struct is_range_selector<or_expression<Left, Right> >: std::true_type {
+};
+
 // constructs piped_expressions from sub expressions using the pipe
 // operator
 template <typename Left, typename Right,
@@ -142,6 +158,17 @@ _where_not<Expression> where_not(Expression e) {
     return _where_not<Expression>(e);
 }
 
+// enables where() to start a sub-expression, e.g.
+// 'where(child("foo")) | attribute("bar")'
+template <typename Expression>
+struct is_expr<_where<Expression> >: std::true_type {
+};
+
+// enables where_not() to start a sub-expression
+template <typename Expression>
+struct is_expr<_where_not<Expression> >: std::true_type {
+};
+
 // The predicate given to the boost filtered_range, when
 // evaluating a where() subexpression.
 template <typename Expression, typename Input>
@@ -153,7 +180,7 @@ public:
     }
 
     bool operator()(Input i) const {
-        auto range =  singleton(i) |e ;
+        auto range =  singleton_ref(i) |e ;
         return range.begin() != range.end();
     }
 };
@@ -169,7 +196,7 @@ public:
     }
 
     bool operator()(Input i) const {
-        auto range =  singleton(i) |e ;
+        auto range =  singleton_ref(i) |e ;
         return range.begin() == range.end();
     }
 };
@@ -234,6 +261,26 @@ struct _toNode { };
 // Type for the first selector
 struct _first { };
 
+// Type for the exists selector
+struct _exists { };
+
+// Type for the count selector
+struct _count { };
+
+// Type for the nth selector, holds the index of the wanted entry
+struct _nth {
+    explicit _nth(std::size_t n) : n(n) {}
+    std::size_t n;
+};
+
+/// Selects the entry with the given index, counting from 0, in the
+/// range, or the default constructed object of the value_type if the
+/// range is shorter. Example: 'range | nth(2)'. Only the entries
+/// before it are visited, and they are not dereferenced.
+inline _nth nth(std::size_t n) {
+    return _nth(n);
+}
+
 namespace {
     /// Selects the node from the underlying DOM implementation,
     /// If this is used, your code will likely not be
@@ -248,6 +295,14 @@ namespace {
     /// previous selector. Returns a string if any of the text
     /// selectors were used.
     const _first first;
+
+    /// Gives true if the range has any entries. Example:
+    /// 'range | exists'. Stops at the first entry.
+    const _exists exists;
+
+    /// Gives the number of entries in the range. Example:
+    /// 'range | count'. The entries are not dereferenced.
+    const _count count;
 }
 
 // Implements the '|' operator in sub-expressions with the 'toNode'
@@ -270,9 +325,47 @@ template <typename Range>
 typename Range::iterator::value_type
 operator|(Range const& range, _first)
 {
+    auto i = range.begin();
+    return
+            i != range.end() ?
+                *i :
+                typename Range::iterator::value_type();
+}
+
+// Implements the '|' operator with the 'exists' selector,
+// e.g. 'range | exists'.
+template <typename Range>
+bool operator|(Range const& range, _exists)
+{
+    return range.begin() != range.end();
+}
+
+// Implements the '|' operator with the 'count' selector,
+// e.g. 'range | count'.
+template <typename Range>
+std::size_t operator|(Range const& range, _count)
+{
+    std::size_t n = 0;
+    for (auto i = range.begin(), end = range.end(); i != end; ++i) {
+        ++n;
+    }
+    return n;
+}
+
+// Implements the '|' operator with the 'nth' selector,
+// e.g. 'range | nth(2)'.
+template <typename Range>
+typename Range::iterator::value_type
+operator|(Range const& range, _nth n)
+{
+    auto i = range.begin();
+    auto end = range.end();
+    for (std::size_t k = 0; k < n.n && i != end; ++k) {
+        ++i;
+    }
     return
-            range.begin() != range.end() ?
-                *(range.begin()) :
+            i != end ?
+                *i :
                 typename Range::iterator::value_type();
 }
 